@@ -25,6 +25,9 @@ project "tests"
     filter { "system:windows" }
         links { "stdc++", "winmm", "gdi32" }
 
+    filter { "system:linux" }
+        links { "pthread" }
+
     filter "configurations:debug"
         defines { "DEBUG" }
         symbols "On"
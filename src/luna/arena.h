@@ -0,0 +1,257 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "vector.h"
+#include "map.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <cassert>
+
+
+namespace luna {
+
+
+
+// an upstream for arenas that must never leave the buffer they were given
+struct NoUpstream {
+    using value_type = std::byte;
+
+    std::byte* allocate (size_t) {
+        assert(false && "arena ran out of its buffer");
+        return nullptr;
+    }
+    void deallocate (std::byte*, size_t) {}
+};
+
+
+/**
+ * @brief Hands out memory by bumping a pointer through blocks taken from _Upstream,
+ * each at least twice the size of the previous one. Deallocation does nothing,
+ * and reset releases everything at once, keeping the last block for reuse.
+ * The latest allocation can be grown or shrunk in place with try_extend, which is
+ * what lets a vector that keeps growing at the end of an arena never move.
+ * A buffer is used by a single thread at a time.
+ */
+template <class _Upstream = std::allocator<std::byte>>
+class BasicMonotonicBuffer {
+public:
+
+    using upstream_type = _Upstream;
+    using upstream_traits = std::allocator_traits<_Upstream>;
+
+    static constexpr size_t default_block_size = 4096;
+
+    explicit BasicMonotonicBuffer (size_t __block_size = default_block_size, const _Upstream& __upstream = {})
+    : _upstream(__upstream), _next_block_size(std::max(__block_size, sizeof(Block) * 2)) {}
+
+    // starts out in buffer, which the arena never frees, going upstream once it is full
+    BasicMonotonicBuffer (void* __buffer, size_t __size, const _Upstream& __upstream = {})
+    : _upstream(__upstream), _next_block_size(std::max(__size * 2, default_block_size)) {
+        _initial = (std::byte*)__buffer;
+        _initial_end = _initial + __size;
+        _cur = _initial;
+        _end = _initial_end;
+    }
+
+    BasicMonotonicBuffer (const BasicMonotonicBuffer&) = delete;
+    BasicMonotonicBuffer& operator= (const BasicMonotonicBuffer&) = delete;
+
+    ~BasicMonotonicBuffer () {
+        _release(nullptr);
+    }
+
+    void* allocate (size_t bytes, size_t align = alignof(std::max_align_t)) {
+        std::byte* ptr = _align(_cur, align);
+        if (!_cur || ptr + bytes > _end) {
+            _grow(bytes + align);
+            ptr = _align(_cur, align);
+        }
+        _cur = ptr + bytes;
+        _used += bytes;
+        return ptr;
+    }
+
+    // does nothing, memory is only released by reset
+    void deallocate (void*, size_t) {}
+
+    // resizes ptr in place if it was the last allocation and the block has room
+    bool try_extend (void* ptr, size_t old_bytes, size_t new_bytes) {
+        std::byte* first = (std::byte*)ptr;
+        if (first + old_bytes != _cur || first + new_bytes > _end) {
+            return false;
+        }
+        _cur = first + new_bytes;
+        _used += new_bytes - old_bytes;
+        return true;
+    }
+
+    // releases every allocation. the most recent block is kept, as it is also the largest
+    void reset () {
+        _release(_blocks);
+        if (_blocks) {
+            _cur = (std::byte*)(_blocks + 1);
+            _end = (std::byte*)_blocks + _blocks->size;
+        } else {
+            _cur = _initial;
+            _end = _initial_end;
+        }
+        _used = 0;
+    }
+
+    // bytes handed out since the last reset, including the growth of extended allocations
+    size_t used () const { return _used; }
+
+private:
+
+    // the header of every upstream block, linking it to the previous one
+    struct alignas(std::max_align_t) Block {
+        Block* prev;
+        size_t size;
+    };
+
+    static std::byte* _align (std::byte* ptr, size_t align) {
+        return (std::byte*)(((uintptr_t)ptr + align - 1) & ~(uintptr_t)(align - 1));
+    }
+
+    void _grow (size_t bytes) {
+        size_t size = std::max(_next_block_size, bytes + sizeof(Block));
+        Block* block = (Block*)upstream_traits::allocate(_upstream, size);
+        block->prev = _blocks;
+        block->size = size;
+        _blocks = block;
+        _cur = (std::byte*)(block + 1);
+        _end = (std::byte*)block + size;
+        _next_block_size = size * 2;
+    }
+
+    // frees every upstream block older than keep, or all of them
+    void _release (Block* keep) {
+        Block* block = keep ? keep->prev : _blocks;
+        while (block) {
+            Block* prev = block->prev;
+            upstream_traits::deallocate(_upstream, (std::byte*)block, block->size);
+            block = prev;
+        }
+        if (keep) {
+            keep->prev = nullptr;
+        } else {
+            _blocks = nullptr;
+        }
+    }
+
+    [[no_unique_address]] _Upstream _upstream;
+    Block* _blocks = nullptr;
+    std::byte* _cur = nullptr;
+    std::byte* _end = nullptr;
+    std::byte* _initial = nullptr;
+    std::byte* _initial_end = nullptr;
+    size_t _next_block_size;
+    size_t _used = 0;
+
+};
+
+using MonotonicBuffer = BasicMonotonicBuffer<>;
+
+
+// the innermost ArenaScope of this thread, per buffer type
+template <class _Buffer>
+inline thread_local _Buffer* current_arena = nullptr;
+
+// makes buffer the arena of every ArenaAllocator default constructed on this thread while it lives
+template <class _Buffer = MonotonicBuffer>
+class ArenaScope {
+public:
+
+    explicit ArenaScope (_Buffer& __buffer)
+    : _prev(current_arena<_Buffer>) {
+        current_arena<_Buffer> = &__buffer;
+    }
+
+    ~ArenaScope () {
+        current_arena<_Buffer> = _prev;
+    }
+
+    ArenaScope (const ArenaScope&) = delete;
+    ArenaScope& operator= (const ArenaScope&) = delete;
+
+private:
+
+    _Buffer* _prev;
+
+};
+
+
+/**
+ * @brief An allocator drawing from a monotonic buffer, to be passed as the _Alloc of any chunk.
+ * Chunks default construct their allocator, so a default constructed ArenaAllocator
+ * binds to the current ArenaScope of its thread, and keeps that buffer for good.
+ * Outside of any scope it falls back to std::allocator, and then frees what it allocates.
+ */
+template <class T, class _Buffer = MonotonicBuffer>
+class ArenaAllocator {
+public:
+
+    using value_type = T;
+    using buffer_type = _Buffer;
+
+    template <class U>
+    struct rebind { using other = ArenaAllocator<U, _Buffer>; };
+
+    ArenaAllocator () : _buffer(current_arena<_Buffer>) {}
+    explicit ArenaAllocator (_Buffer& __buffer) : _buffer(&__buffer) {}
+
+    template <class U>
+    ArenaAllocator (const ArenaAllocator<U, _Buffer>& other) : _buffer(other.buffer()) {}
+
+    T* allocate (size_t count) {
+        if (!_buffer) {
+            return std::allocator<T>().allocate(count);
+        }
+        return (T*)_buffer->allocate(count * sizeof(T), alignof(T));
+    }
+
+    void deallocate (T* ptr, size_t count) {
+        if (!_buffer) {
+            std::allocator<T>().deallocate(ptr, count);
+        }
+    }
+
+    // grows an allocation in place, see BasicMonotonicBuffer::try_extend
+    bool try_extend (T* ptr, size_t old_count, size_t new_count) {
+        return _buffer && _buffer->try_extend(ptr, old_count * sizeof(T), new_count * sizeof(T));
+    }
+
+    _Buffer* buffer () const { return _buffer; }
+
+    template <class U>
+    bool operator== (const ArenaAllocator<U, _Buffer>& other) const { return _buffer == other.buffer(); }
+
+private:
+
+    _Buffer* _buffer;
+
+};
+
+
+template <class T>
+using ArenaVector = Vector<T, ArenaAllocator<T>>;
+
+// a map drawing all of its memory from the ArenaScope it was created in, see ArenaAllocator
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using ArenaMap = BasicMap<
+    HeapArrayChunk<_Key, ArenaAllocator<_Key>>,
+    HeapArrayChunk<_Val, ArenaAllocator<_Val>>,
+    HeapArrayChunk<index_t, ArenaAllocator<index_t>>,
+    _Hasher,
+    _Equal
+>;
+
+
+
+} // namespace luna
@@ -0,0 +1,288 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "vector.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <type_traits>
+
+
+namespace luna {
+
+
+
+/**
+ * @brief A Bloom filter split into blocks of one cache line.
+ * A hash picks a single block and sets one bit in each of its 8 words,
+ * so adding or testing a hash touches exactly one cache line.
+ * Hashes are mixed first, so weak hashers like std::hash<int> still spread.
+ */
+template <class _Alloc = std::allocator<uint64_t>>
+class BasicBlockedBloomFilter {
+public:
+
+    using size_type = index_t;
+    using chunk_type = HeapArrayChunk<uint64_t,
+        typename std::allocator_traits<_Alloc>::template rebind_alloc<uint64_t>>;
+
+    static constexpr size_type block_words = 8;
+    static constexpr size_type block_bits = block_words * 64;
+
+    // clears the filter, sizing it for count hashes at bits_per_key bits each
+    void reset (size_type count, size_type bits_per_key) {
+        size_type blocks = std::max((size_type)(((int64_t)count * bits_per_key + block_bits - 1) / block_bits), 1);
+        // one spare block, so the first can be aligned to a cache line
+        _words.clear();
+        _words.resize((blocks + 1) * block_words, 0);
+        _offset = (size_type)((-(uintptr_t)_words.data() / sizeof(uint64_t)) & (block_words - 1));
+        _block_count = blocks;
+    }
+
+    void add (size_t hash) {
+        uint64_t h = _mix(hash);
+        uint64_t* block = _block(h);
+        for (size_type i = 0; i < block_words; i++) {
+            block[i] |= _bit(h, i);
+        }
+    }
+
+    // false only if hash was never added since the last reset
+    bool may_contain (size_t hash) const {
+        uint64_t h = _mix(hash);
+        const uint64_t* block = _block(h);
+        uint64_t missing = 0;
+        for (size_type i = 0; i < block_words; i++) {
+            missing |= ~block[i] & _bit(h, i);
+        }
+        return missing == 0;
+    }
+
+    void prefetch_block (size_t hash) const {
+        prefetch(_block(_mix(hash)));
+    }
+
+    size_type block_count () const { return _block_count; }
+
+private:
+
+    static constexpr uint32_t _salts[block_words] = {
+        0x47b6137bu, 0x44974d91u, 0x8824ad5bu, 0xa2b7289du,
+        0x705495c7u, 0x2df1424bu, 0x9efc4947u, 0x5c6bfb31u
+    };
+
+    static uint64_t _mix (size_t hash) {
+        uint64_t h = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+
+    // the high half picks the block, the low half the bits within it
+    static uint64_t _bit (uint64_t h, size_type word) {
+        return 1ull << (((uint32_t)h * _salts[word]) >> 26);
+    }
+
+    uint64_t* _block (uint64_t h) {
+        return _words.data() + _offset + ((h >> 32) * _block_count >> 32) * block_words;
+    }
+
+    const uint64_t* _block (uint64_t h) const {
+        return _words.data() + _offset + ((h >> 32) * _block_count >> 32) * block_words;
+    }
+
+    BasicVector<chunk_type> _words;
+    size_type _offset = 0;
+    size_type _block_count = 0;
+
+};
+
+using BlockedBloomFilter = BasicBlockedBloomFilter<>;
+
+
+// the elements of a BasicBloomBuckets, a lookup stops once the filter rules its hash out
+template <class _Elt>
+struct BloomElt : _Elt {
+    bool at_end () const { return filtered || _Elt::at_end(); }
+
+    size_t filter_hash = 0;
+    bool checked = false;
+    bool filtered = false;
+};
+
+
+/**
+ * @brief Puts a blocked Bloom filter in front of another bucket policy.
+ * Every linked hash is added to the filter, and a lookup tests the filter
+ * before reading any bucket, so most misses cost one cache line and never
+ * walk a chain or compare an element.
+ * Hits pay for the filter line on top of their bucket, so this only pays off
+ * where most lookups miss, and no Set or Map alias picks it by default.
+ * A filter cannot forget a hash, so removed elements keep their bits set.
+ * Once more hashes have been added than the filter was sized for, whether
+ * through growth or churn, needs_rebuild asks the set to refill the filter
+ * through reset_filter and filter_add, which relinks nothing.
+ */
+template <class _Buckets, index_t _BitsPerKey = 12>
+class BasicBloomBuckets {
+public:
+
+    using inner_type = _Buckets;
+    using size_type = index_t;
+    using elt_type = BloomElt<typename inner_type::elt_type>;
+    using filter_type = BasicBlockedBloomFilter<>;
+
+    static constexpr size_type bits_per_key = _BitsPerKey;
+    static constexpr bool stores_hash = [] {
+        if constexpr (requires { inner_type::stores_hash; }) {
+            return inner_type::stores_hash;
+        } else {
+            return false;
+        }
+    }();
+
+    static_assert(![] {
+        if constexpr (requires { inner_type::incremental; }) {
+            return inner_type::incremental;
+        } else {
+            return false;
+        }
+    }(), "the filter is rebuilt by full rehashes, which incremental buckets exist to avoid");
+
+    // sizes the filter for twice the elements linked so far, or one per bucket
+    void resize_buckets (size_type count) {
+        _buckets.resize_buckets(count);
+        _reset_filter();
+    }
+
+    elt_type bucket_start (size_t hash) const {
+        return elt_type{ _buckets.bucket_start(hash), hash };
+    }
+
+    // the filter block is fetched along with the bucket, as most lookups are expected to stop there
+    void prefetch_bucket (const elt_type& elt) const {
+        if (!elt.checked) {
+            _filter.prefetch_block(elt.filter_hash);
+        }
+        if (!elt.filtered) {
+            _buckets.prefetch_bucket(elt);
+        }
+    }
+
+    bool get (elt_type& elt) const {
+        if (!elt.checked) {
+            elt.checked = true;
+            elt.filtered = !_filter.may_contain(elt.filter_hash);
+        }
+        if (elt.filtered) {
+            return false;
+        }
+        return _buckets.get(elt);
+    }
+
+    // a filtered lookup never reached its bucket, so the element is linked as a fresh insert
+    void bucket_append (const elt_type& elt, size_type index) {
+        if (elt.filtered) {
+            _buckets.bucket_insert(elt.filter_hash, index);
+        } else {
+            _buckets.bucket_append(elt, index);
+        }
+        _add(elt.filter_hash);
+    }
+
+    void bucket_link_before (const elt_type& elt, size_type index)
+    requires requires (inner_type& buckets) { buckets.bucket_link_before(elt, index); } {
+        if (elt.filtered) {
+            _buckets.bucket_insert(elt.filter_hash, index);
+        } else {
+            _buckets.bucket_link_before(elt, index);
+        }
+        _add(elt.filter_hash);
+    }
+
+    void bucket_insert (size_t hash, size_type index) {
+        _buckets.bucket_insert(hash, index);
+        _add(hash);
+    }
+
+    // the buckets are linked in parallel, the filter serially after them
+    template <class _Valid>
+    void bucket_insert_parallel (Span<const size_t> hashes, _Valid&& is_valid, size_type thread_count)
+    requires requires (inner_type& buckets) { buckets.bucket_insert_parallel(hashes, is_valid, thread_count); } {
+        _buckets.bucket_insert_parallel(hashes, is_valid, thread_count);
+        for (size_type i = 0; i < hashes.size(); i++) {
+            if (is_valid(i)) {
+                _add(hashes[i]);
+            }
+        }
+    }
+
+    void bucket_remove (const elt_type& elt) {
+        _buckets.bucket_remove(elt);
+        _live--;
+    }
+
+    // the filter only holds hashes, so renumbering leaves it as is
+    void remap_indexes (Span<const index_t> remap, size_type count) {
+        _buckets.remap_indexes(remap, count);
+    }
+
+    size_t stored_hash (size_type index) const requires stores_hash {
+        return _buckets.stored_hash(index);
+    }
+
+    bool needs_rehash (size_type count, size_type max_depth) const {
+        return _buckets.needs_rehash(count, max_depth);
+    }
+
+    size_type rehash_count (size_type count, size_type resize_scaler) const {
+        return _buckets.rehash_count(count, resize_scaler);
+    }
+
+    size_type bucket_count_for (size_type count, size_type max_depth) const {
+        return _buckets.bucket_count_for(count, max_depth);
+    }
+
+    // true once the false positive rate has drifted above what the filter was sized for
+    bool needs_rebuild () const {
+        return _added > _capacity;
+    }
+
+    // clears the filter, sized for the elements linked now, whose hashes must all be passed to filter_add
+    void reset_filter () {
+        _reset_filter();
+    }
+
+    // adds the hash of an element that is already linked
+    void filter_add (size_t hash) {
+        _add(hash);
+    }
+
+    size_type bucket_count () const { return _buckets.bucket_count(); }
+    const filter_type& filter () const { return _filter; }
+
+private:
+
+    void _reset_filter () {
+        _capacity = std::max(_live * 2, _buckets.bucket_count());
+        _filter.reset(_capacity, bits_per_key);
+        _live = 0;
+        _added = 0;
+    }
+
+    void _add (size_t hash) {
+        _filter.add(hash);
+        _live++;
+        _added++;
+    }
+
+    inner_type _buckets;
+    filter_type _filter;
+    // elements linked now, and hashes added to the filter since it was last reset
+    size_type _live = 0;
+    size_type _added = 0;
+    size_type _capacity = 0;
+
+};
+
+
+
+} // namespace luna
@@ -0,0 +1,715 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "probe-vector.h"
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <memory>
+#include <optional>
+#include <ranges>
+#include <type_traits>
+#include <utility>
+#include <cassert>
+
+
+/**
+ * @brief An ordered map or set stored as a B+ tree.
+ * Every node holds up to _Fanout keys in an InplaceArrayChunk, so a node is a few
+ * contiguous cache lines rather than one allocation per element. Values only live
+ * in the leaves, which are linked to the next one, so ordered iteration and range
+ * scans walk arrays instead of chasing parent pointers.
+ * Within a node keys are found with a branchless binary search, or with SSE2 compares
+ * of 4 keys at a time for 32 bit integers. Nodes are allocated through _Alloc.
+ * With a _Val of void, the tree is a set.
+ * Inserting or removing an element invalidates every iterator.
+ */
+
+namespace luna {
+
+
+
+// enough keys per node to fill a few cache lines, without making shifts expensive
+template <class _Key>
+inline constexpr index_t btree_fanout = std::clamp<index_t>((index_t)(256 / sizeof(_Key)), 8, 64);
+
+
+template <
+    class _Key,
+    class _Val,
+    LessC<_Key, _Key> _Less = BasicLess<_Key>,
+    class _Alloc = std::allocator<_Key>,
+    index_t _Fanout = btree_fanout<_Key>>
+class BasicBTree {
+
+    static_assert(_Fanout >= 4, "nodes need room to split and merge");
+
+    struct NoValues {};
+    struct Leaf;
+    struct Inner;
+
+public:
+
+    using key_type = _Key;
+    using value_type = std::conditional_t<std::is_void_v<_Val>, _Key, _Val>;
+    using size_type = index_t;
+    using key_compare = _Less;
+    using allocator = _Alloc;
+
+    static constexpr bool is_set = std::is_void_v<_Val>;
+    static constexpr size_type fanout = _Fanout;
+    // every node but the root keeps at least this many keys
+    static constexpr size_type min_count = _Fanout / 2;
+    // a tree of max_height levels holds at least 2 * (_Fanout / 2) ^ (max_height - 1) elements
+    static constexpr size_type max_height = 32;
+
+    template <bool _Const>
+    class Iterator {
+    public:
+
+        using leaf_pointer = std::conditional_t<_Const, const Leaf*, Leaf*>;
+        using mapped_type = std::conditional_t<_Const, const typename BasicBTree::value_type, typename BasicBTree::value_type>;
+
+        using value_type = std::conditional_t<is_set, _Key, std::pair<_Key, typename BasicBTree::value_type>>;
+        using reference = std::conditional_t<is_set, const _Key&, std::pair<const _Key&, mapped_type&>>;
+        using difference_type = std::ptrdiff_t;
+        using iterator_category = std::forward_iterator_tag;
+
+        constexpr Iterator (leaf_pointer __leaf = nullptr, size_type __index = 0)
+        : _leaf(__leaf), _index(__index) {}
+
+        // a const iterator from a mutable one
+        template <bool _OtherConst>
+        constexpr Iterator (const Iterator<_OtherConst>& other) requires (_Const && !_OtherConst)
+        : _leaf(other.leaf()), _index(other.index()) {}
+
+        constexpr reference operator* () const {
+            if constexpr (is_set) {
+                return _leaf->keys.data()[_index];
+            } else {
+                return reference(_leaf->keys.data()[_index], _leaf->vals.data()[_index]);
+            }
+        }
+
+        constexpr const _Key& key () const { return _leaf->keys.data()[_index]; }
+
+        constexpr mapped_type& value () const requires (!is_set) {
+            return _leaf->vals.data()[_index];
+        }
+
+        constexpr Iterator& operator++ () {
+            if (++_index == _leaf->count) {
+                _leaf = _leaf->next;
+                _index = 0;
+            }
+            return *this;
+        }
+        constexpr Iterator operator++ (int) {
+            Iterator a(_leaf, _index);
+            operator++();
+            return a;
+        }
+
+        constexpr bool operator== (const Iterator& a) const { return _leaf == a._leaf && _index == a._index; }
+        constexpr bool operator!= (const Iterator& a) const { return !operator==(a); }
+
+        constexpr leaf_pointer leaf () const { return _leaf; }
+        constexpr size_type index () const { return _index; }
+
+    private:
+
+        leaf_pointer _leaf;
+        size_type _index;
+
+    };
+
+    using iterator = Iterator<false>;
+    using const_iterator = Iterator<true>;
+
+    BasicBTree (const _Less& __less = {}, const _Alloc& __alloc = {})
+    : _less(__less), _leaf_alloc(__alloc), _inner_alloc(__alloc) {}
+
+    BasicBTree (const BasicBTree&) = delete;
+    BasicBTree& operator= (const BasicBTree&) = delete;
+
+    BasicBTree (BasicBTree&& other)
+    : _less(other._less), _leaf_alloc(other._leaf_alloc), _inner_alloc(other._inner_alloc)
+    , _root(std::exchange(other._root, nullptr))
+    , _height(std::exchange(other._height, 0))
+    , _size(std::exchange(other._size, 0)) {}
+
+    ~BasicBTree () {
+        clear();
+    }
+
+    // constructs a value from args if key is missing, returns the element of key and whether it was inserted
+    template <class... _Args>
+    std::pair<iterator, bool> emplace (const _Key& key, _Args&&... args) {
+        if (!_root) {
+            _root = _new_leaf();
+            _height = 0;
+        }
+        Inner* path[max_height];
+        size_type slots[max_height];
+        Leaf* leaf = _descend(key, path, slots);
+        size_type pos = _lower(leaf->keys.data(), leaf->count, key);
+        if (pos < leaf->count && !_less.less(key, leaf->keys.data()[pos])) {
+            return std::make_pair(iterator(leaf, pos), false);
+        }
+        _size++;
+        if (leaf->count < _Fanout) {
+            _leaf_insert(leaf, pos, key, std::forward<_Args>(args)...);
+            return std::make_pair(iterator(leaf, pos), true);
+        }
+
+        // splits the full leaf, the inserted element counting towards either half
+        Leaf* right = _new_leaf();
+        size_type left_count = (_Fanout + 1) / 2;
+        Leaf* target = leaf;
+        size_type target_pos = pos;
+        if (pos < left_count) {
+            _leaf_transfer(leaf, left_count - 1, _Fanout - left_count + 1, right, 0);
+            leaf->count = left_count - 1;
+            right->count = _Fanout - left_count + 1;
+        } else {
+            _leaf_transfer(leaf, left_count, _Fanout - left_count, right, 0);
+            leaf->count = left_count;
+            right->count = _Fanout - left_count;
+            target = right;
+            target_pos = pos - left_count;
+        }
+        _leaf_insert(target, target_pos, key, std::forward<_Args>(args)...);
+        right->next = leaf->next;
+        leaf->next = right;
+        _insert_separator(path, slots, right->keys.data()[0], right);
+        return std::make_pair(iterator(target, target_pos), true);
+    }
+
+    std::pair<iterator, bool> insert (const _Key& key) requires is_set {
+        return emplace(key);
+    }
+
+    std::pair<iterator, bool> insert (const _Key& key, const value_type& val) requires (!is_set) {
+        return emplace(key, val);
+    }
+
+    // overwrites the value of key if it is already there
+    std::pair<iterator, bool> insert_or_assign (const _Key& key, const value_type& val) requires (!is_set) {
+        auto [it, inserted] = emplace(key, val);
+        if (!inserted) {
+            it.value() = val;
+        }
+        return std::make_pair(it, inserted);
+    }
+
+    // returns whether key was there
+    bool remove (const _Key& key) {
+        if (!_root) return false;
+        Inner* path[max_height];
+        size_type slots[max_height];
+        Leaf* leaf = _descend(key, path, slots);
+        size_type pos = _lower(leaf->keys.data(), leaf->count, key);
+        if (pos == leaf->count || _less.less(key, leaf->keys.data()[pos])) {
+            return false;
+        }
+        _leaf_erase(leaf, pos);
+        _size--;
+        _rebalance_leaf(leaf, path, slots);
+        return true;
+    }
+
+    value_type* find (const _Key& key) requires (!is_set) {
+        iterator it = _find(key);
+        return it == end() ? nullptr : &it.value();
+    }
+
+    const value_type* find (const _Key& key) const {
+        const_iterator it = _find(key);
+        if constexpr (is_set) {
+            return it == end() ? nullptr : &it.key();
+        } else {
+            return it == end() ? nullptr : &it.value();
+        }
+    }
+
+    bool contains (const _Key& key) const {
+        return _find(key) != end();
+    }
+
+    value_type& at (const _Key& key) requires (!is_set) {
+        value_type* val = find(key);
+        assert(val);
+        return *val;
+    }
+
+    const value_type& at (const _Key& key) const requires (!is_set) {
+        const value_type* val = find(key);
+        assert(val);
+        return *val;
+    }
+
+    value_type& operator[] (const _Key& key) requires (!is_set) {
+        return emplace(key).first.value();
+    }
+
+    // the first element not less than key
+    iterator lower_bound (const _Key& key) { return _bound<false, iterator>(this, key); }
+    const_iterator lower_bound (const _Key& key) const { return _bound<false, const_iterator>(this, key); }
+
+    // the first element greater than key
+    iterator upper_bound (const _Key& key) { return _bound<true, iterator>(this, key); }
+    const_iterator upper_bound (const _Key& key) const { return _bound<true, const_iterator>(this, key); }
+
+    // the elements with keys in [first, last)
+    auto range (const _Key& first, const _Key& last) {
+        return std::ranges::subrange(lower_bound(first), lower_bound(last));
+    }
+    auto range (const _Key& first, const _Key& last) const {
+        return std::ranges::subrange(lower_bound(first), lower_bound(last));
+    }
+
+    iterator begin () { return iterator(_first_leaf(), 0); }
+    iterator end () { return iterator(); }
+    const_iterator begin () const { return const_iterator(_first_leaf(), 0); }
+    const_iterator end () const { return const_iterator(); }
+
+    void clear () {
+        if (_root) {
+            _free(_root, _height);
+        }
+        _root = nullptr;
+        _height = 0;
+        _size = 0;
+    }
+
+    size_type size () const { return _size; }
+    bool empty () const { return _size == 0; }
+    // levels of inner nodes above the leaves
+    size_type height () const { return _height; }
+
+private:
+
+    using key_chunk_type = InplaceArrayChunk<_Key, _Fanout,
+        typename std::allocator_traits<_Alloc>::template rebind_alloc<_Key>>;
+    using val_chunk_type = std::conditional_t<is_set, NoValues, InplaceArrayChunk<value_type, _Fanout,
+        typename std::allocator_traits<_Alloc>::template rebind_alloc<value_type>>>;
+
+    struct Node {
+        size_type count = 0;
+    };
+
+    struct Leaf : Node {
+        key_chunk_type keys;
+        [[no_unique_address]] val_chunk_type vals;
+        Leaf* next = nullptr;
+    };
+
+    // children[i] holds the keys less than keys[i], children[i + 1] the others
+    struct Inner : Node {
+        key_chunk_type keys;
+        Node* children[_Fanout + 1];
+    };
+
+    using leaf_alloc_type = typename std::allocator_traits<_Alloc>::template rebind_alloc<Leaf>;
+    using inner_alloc_type = typename std::allocator_traits<_Alloc>::template rebind_alloc<Inner>;
+    using leaf_traits = std::allocator_traits<leaf_alloc_type>;
+    using inner_traits = std::allocator_traits<inner_alloc_type>;
+
+    // the number of keys less than key, or with _Upper not greater than key
+    template <bool _Upper>
+    size_type _search (const _Key* keys, size_type count, const _Key& key) const {
+#ifdef LUNA_SSE2
+        if constexpr (std::is_same_v<_Key, int32_t> && std::is_same_v<_Less, BasicLess<_Key>>) {
+            // _Upper counts the keys greater than key and keeps the rest
+            __m128i needle = _mm_set1_epi32(key);
+            size_type n = 0;
+            size_type i = 0;
+            for (; i + 4 <= count; i += 4) {
+                __m128i group = _mm_loadu_si128((const __m128i*)(keys + i));
+                __m128i ok = _Upper ? _mm_cmpgt_epi32(group, needle) : _mm_cmplt_epi32(group, needle);
+                unsigned bits = std::popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(ok)));
+                n += _Upper ? 4 - bits : bits;
+            }
+            for (; i < count; i++) {
+                n += _Upper ? !(key < keys[i]) : keys[i] < key;
+            }
+            return n;
+        }
+#endif
+        if (count == 0) return 0;
+        const _Key* base = keys;
+        while (count > 1) {
+            size_type half = count / 2;
+            bool right = _Upper ? !_less.less(key, base[half - 1]) : _less.less(base[half - 1], key);
+            base = right ? base + half : base;
+            count -= half;
+        }
+        return (size_type)(base - keys) + (_Upper ? !_less.less(key, *base) : _less.less(*base, key));
+    }
+
+    size_type _lower (const _Key* keys, size_type count, const _Key& key) const {
+        return _search<false>(keys, count, key);
+    }
+
+    size_type _upper (const _Key* keys, size_type count, const _Key& key) const {
+        return _search<true>(keys, count, key);
+    }
+
+    // walks down to the leaf key belongs in, recording the inner nodes and child slots taken
+    Leaf* _descend (const _Key& key, Inner** path, size_type* slots) const {
+        Node* node = _root;
+        for (size_type level = 0; level < _height; level++) {
+            Inner* inner = (Inner*)node;
+            size_type slot = _upper(inner->keys.data(), inner->count, key);
+            path[level] = inner;
+            slots[level] = slot;
+            node = inner->children[slot];
+        }
+        return (Leaf*)node;
+    }
+
+    Leaf* _leaf_of (const _Key& key) const {
+        Node* node = _root;
+        for (size_type level = 0; level < _height; level++) {
+            Inner* inner = (Inner*)node;
+            node = inner->children[_upper(inner->keys.data(), inner->count, key)];
+        }
+        return (Leaf*)node;
+    }
+
+    Leaf* _first_leaf () const {
+        Node* node = _root;
+        for (size_type level = 0; level < _height && node; level++) {
+            node = ((Inner*)node)->children[0];
+        }
+        return (Leaf*)node;
+    }
+
+    const_iterator _find (const _Key& key) const {
+        if (!_root) return end();
+        Leaf* leaf = _leaf_of(key);
+        size_type pos = _lower(leaf->keys.data(), leaf->count, key);
+        if (pos < leaf->count && !_less.less(key, leaf->keys.data()[pos])) {
+            return const_iterator(leaf, pos);
+        }
+        return end();
+    }
+
+    iterator _find (const _Key& key) {
+        const_iterator it = std::as_const(*this)._find(key);
+        return iterator(const_cast<Leaf*>(it.leaf()), it.index());
+    }
+
+    // the separators only bound their subtrees, so the bound may be past the end of its leaf
+    template <bool _Upper, class _It, class _Self>
+    static _It _bound (_Self* self, const _Key& key) {
+        if (!self->_root) return _It();
+        Leaf* leaf = self->_leaf_of(key);
+        size_type pos = self->template _search<_Upper>(leaf->keys.data(), leaf->count, key);
+        if (pos == leaf->count) {
+            return _It(leaf->next, 0);
+        }
+        return _It(leaf, pos);
+    }
+
+    Leaf* _new_leaf () {
+        Leaf* leaf = leaf_traits::allocate(_leaf_alloc, 1);
+        leaf_traits::construct(_leaf_alloc, leaf);
+        return leaf;
+    }
+
+    Inner* _new_inner () {
+        Inner* inner = inner_traits::allocate(_inner_alloc, 1);
+        inner_traits::construct(_inner_alloc, inner);
+        return inner;
+    }
+
+    void _delete_leaf (Leaf* leaf) {
+        leaf_traits::destroy(_leaf_alloc, leaf);
+        leaf_traits::deallocate(_leaf_alloc, leaf, 1);
+    }
+
+    void _delete_inner (Inner* inner) {
+        inner_traits::destroy(_inner_alloc, inner);
+        inner_traits::deallocate(_inner_alloc, inner, 1);
+    }
+
+    void _free (Node* node, size_type height) {
+        if (height == 0) {
+            Leaf* leaf = (Leaf*)node;
+            for (size_type i = 0; i < leaf->count; i++) {
+                leaf->keys.destroy(i);
+                if constexpr (!is_set) {
+                    leaf->vals.destroy(i);
+                }
+            }
+            _delete_leaf(leaf);
+            return;
+        }
+        Inner* inner = (Inner*)node;
+        for (size_type i = 0; i <= inner->count; i++) {
+            _free(inner->children[i], height - 1);
+        }
+        for (size_type i = 0; i < inner->count; i++) {
+            inner->keys.destroy(i);
+        }
+        _delete_inner(inner);
+    }
+
+    // shifts [pos, count) one to the right, leaving pos unconstructed
+    template <class _Chunk>
+    static void _open (_Chunk& chunk, size_type count, size_type pos) {
+        auto* data = chunk.data();
+        for (size_type i = count; i > pos; i--) {
+            chunk.construct(data + i, std::move(data[i - 1]));
+            chunk.destroy(data + i - 1);
+        }
+    }
+
+    // destroys pos and shifts (pos, count) one to the left
+    template <class _Chunk>
+    static void _close (_Chunk& chunk, size_type count, size_type pos) {
+        auto* data = chunk.data();
+        chunk.destroy(data + pos);
+        for (size_type i = pos + 1; i < count; i++) {
+            chunk.construct(data + i - 1, std::move(data[i]));
+            chunk.destroy(data + i);
+        }
+    }
+
+    // moves count elements from first in src to the unconstructed at in dst
+    template <class _Chunk>
+    static void _transfer (_Chunk& src, size_type first, size_type count, _Chunk& dst, size_type at) {
+        for (size_type i = 0; i < count; i++) {
+            dst.construct(dst.data() + at + i, std::move(src.data()[first + i]));
+            src.destroy(src.data() + first + i);
+        }
+    }
+
+    void _leaf_transfer (Leaf* src, size_type first, size_type count, Leaf* dst, size_type at) {
+        _transfer(src->keys, first, count, dst->keys, at);
+        if constexpr (!is_set) {
+            _transfer(src->vals, first, count, dst->vals, at);
+        }
+    }
+
+    template <class... _Args>
+    void _leaf_insert (Leaf* leaf, size_type pos, const _Key& key, _Args&&... args) {
+        _open(leaf->keys, leaf->count, pos);
+        leaf->keys.construct(leaf->keys.data() + pos, key);
+        if constexpr (!is_set) {
+            _open(leaf->vals, leaf->count, pos);
+            leaf->vals.construct(leaf->vals.data() + pos, std::forward<_Args>(args)...);
+        }
+        leaf->count++;
+    }
+
+    void _leaf_erase (Leaf* leaf, size_type pos) {
+        _close(leaf->keys, leaf->count, pos);
+        if constexpr (!is_set) {
+            _close(leaf->vals, leaf->count, pos);
+        }
+        leaf->count--;
+    }
+
+    // inserts key at pos, and child right after it
+    void _inner_insert (Inner* inner, size_type pos, const _Key& key, Node* child) {
+        _open(inner->keys, inner->count, pos);
+        inner->keys.construct(inner->keys.data() + pos, key);
+        std::copy_backward(inner->children + pos + 1, inner->children + inner->count + 1, inner->children + inner->count + 2);
+        inner->children[pos + 1] = child;
+        inner->count++;
+    }
+
+    // removes the key at pos, and the child right after it
+    void _inner_erase (Inner* inner, size_type pos) {
+        _close(inner->keys, inner->count, pos);
+        std::copy(inner->children + pos + 2, inner->children + inner->count + 1, inner->children + pos + 1);
+        inner->count--;
+    }
+
+    // links child, whose keys are all at least key, right after the child slot taken at each level,
+    // splitting full inner nodes on the way up
+    void _insert_separator (Inner** path, size_type* slots, const _Key& key, Node* child) {
+        std::optional<_Key> carried;
+        const _Key* sep = &key;
+        constexpr size_type m = _Fanout / 2;
+        for (size_type level = _height; level-- > 0;) {
+            Inner* inner = path[level];
+            size_type pos = slots[level];
+            if (inner->count < _Fanout) {
+                _inner_insert(inner, pos, *sep, child);
+                return;
+            }
+
+            // of the _Fanout + 1 keys, the first m stay, the next goes up and the rest move right
+            Inner* right = _new_inner();
+            std::optional<_Key> up;
+            if (pos < m) {
+                up.emplace(std::move(inner->keys.data()[m - 1]));
+                inner->keys.destroy(m - 1);
+                _transfer(inner->keys, m, _Fanout - m, right->keys, 0);
+                std::copy(inner->children + m, inner->children + _Fanout + 1, right->children);
+                inner->count = m - 1;
+                right->count = _Fanout - m;
+                _inner_insert(inner, pos, *sep, child);
+            } else if (pos == m) {
+                up.emplace(*sep);
+                _transfer(inner->keys, m, _Fanout - m, right->keys, 0);
+                right->children[0] = child;
+                std::copy(inner->children + m + 1, inner->children + _Fanout + 1, right->children + 1);
+                inner->count = m;
+                right->count = _Fanout - m;
+            } else {
+                up.emplace(std::move(inner->keys.data()[m]));
+                inner->keys.destroy(m);
+                _transfer(inner->keys, m + 1, _Fanout - m - 1, right->keys, 0);
+                std::copy(inner->children + m + 1, inner->children + _Fanout + 1, right->children);
+                inner->count = m;
+                right->count = _Fanout - m - 1;
+                _inner_insert(right, pos - m - 1, *sep, child);
+            }
+            carried = std::move(up);
+            sep = &*carried;
+            child = right;
+        }
+
+        assert(_height + 1 < max_height);
+        Inner* root = _new_inner();
+        root->keys.construct(root->keys.data(), *sep);
+        root->children[0] = _root;
+        root->children[1] = child;
+        root->count = 1;
+        _root = root;
+        _height++;
+    }
+
+    // refills a leaf left with too few elements from a sibling, or merges the two
+    void _rebalance_leaf (Leaf* leaf, Inner** path, size_type* slots) {
+        if (_height == 0) {
+            if (leaf->count == 0) {
+                _delete_leaf(leaf);
+                _root = nullptr;
+            }
+            return;
+        }
+        if (leaf->count >= min_count) return;
+
+        Inner* parent = path[_height - 1];
+        size_type slot = slots[_height - 1];
+        Leaf* left = slot > 0 ? (Leaf*)parent->children[slot - 1] : nullptr;
+        Leaf* right = slot < parent->count ? (Leaf*)parent->children[slot + 1] : nullptr;
+        if (left && left->count > min_count) {
+            _open(leaf->keys, leaf->count, 0);
+            if constexpr (!is_set) {
+                _open(leaf->vals, leaf->count, 0);
+            }
+            _leaf_transfer(left, left->count - 1, 1, leaf, 0);
+            left->count--;
+            leaf->count++;
+            parent->keys.data()[slot - 1] = leaf->keys.data()[0];
+            return;
+        }
+        if (right && right->count > min_count) {
+            _leaf_transfer(right, 0, 1, leaf, leaf->count);
+            leaf->count++;
+            // the first element of right was moved out, so its slot is closed without being destroyed again
+            for (size_type i = 1; i < right->count; i++) {
+                _leaf_transfer(right, i, 1, right, i - 1);
+            }
+            right->count--;
+            parent->keys.data()[slot] = right->keys.data()[0];
+            return;
+        }
+
+        size_type sep = left ? slot - 1 : slot;
+        Leaf* into = left ? left : leaf;
+        Leaf* from = left ? leaf : right;
+        _leaf_transfer(from, 0, from->count, into, into->count);
+        into->count += from->count;
+        into->next = from->next;
+        _delete_leaf(from);
+        _inner_erase(parent, sep);
+        _rebalance_inner(path, slots, _height - 1);
+    }
+
+    void _rebalance_inner (Inner** path, size_type* slots, size_type level) {
+        while (true) {
+            Inner* inner = path[level];
+            if (level == 0) {
+                if (inner->count == 0) {
+                    _root = inner->children[0];
+                    _delete_inner(inner);
+                    _height--;
+                }
+                return;
+            }
+            if (inner->count >= min_count) return;
+
+            Inner* parent = path[level - 1];
+            size_type slot = slots[level - 1];
+            Inner* left = slot > 0 ? (Inner*)parent->children[slot - 1] : nullptr;
+            Inner* right = slot < parent->count ? (Inner*)parent->children[slot + 1] : nullptr;
+            // keys rotate through the parent separator
+            if (left && left->count > min_count) {
+                _open(inner->keys, inner->count, 0);
+                _transfer(parent->keys, slot - 1, 1, inner->keys, 0);
+                _transfer(left->keys, left->count - 1, 1, parent->keys, slot - 1);
+                std::copy_backward(inner->children, inner->children + inner->count + 1, inner->children + inner->count + 2);
+                inner->children[0] = left->children[left->count];
+                left->count--;
+                inner->count++;
+                return;
+            }
+            if (right && right->count > min_count) {
+                _transfer(parent->keys, slot, 1, inner->keys, inner->count);
+                inner->children[inner->count + 1] = right->children[0];
+                inner->count++;
+                _transfer(right->keys, 0, 1, parent->keys, slot);
+                for (size_type i = 1; i < right->count; i++) {
+                    _transfer(right->keys, i, 1, right->keys, i - 1);
+                }
+                std::copy(right->children + 1, right->children + right->count + 1, right->children);
+                right->count--;
+                return;
+            }
+
+            size_type sep = left ? slot - 1 : slot;
+            Inner* into = left ? left : inner;
+            Inner* from = left ? inner : right;
+            _transfer(parent->keys, sep, 1, into->keys, into->count);
+            _transfer(from->keys, 0, from->count, into->keys, into->count + 1);
+            std::copy(from->children, from->children + from->count + 1, into->children + into->count + 1);
+            into->count += from->count + 1;
+            _delete_inner(from);
+            // the separator was moved down, so only its slot and the child after it are closed
+            for (size_type i = sep + 1; i < parent->count; i++) {
+                _transfer(parent->keys, i, 1, parent->keys, i - 1);
+            }
+            std::copy(parent->children + sep + 2, parent->children + parent->count + 1, parent->children + sep + 1);
+            parent->count--;
+            level--;
+        }
+    }
+
+    [[no_unique_address]] _Less _less;
+    [[no_unique_address]] leaf_alloc_type _leaf_alloc;
+    [[no_unique_address]] inner_alloc_type _inner_alloc;
+    Node* _root = nullptr;
+    size_type _height = 0;
+    size_type _size = 0;
+
+};
+
+
+template <class _Key, class _Val, LessC<_Key, _Key> _Less = BasicLess<_Key>>
+using BTreeMap = BasicBTree<_Key, _Val, _Less>;
+
+template <class _Key, LessC<_Key, _Key> _Less = BasicLess<_Key>>
+using BTreeSet = BasicBTree<_Key, void, _Less>;
+
+
+
+} // namespace luna
@@ -0,0 +1,129 @@
+#pragma once
+#include "index.h"
+#include <algorithm>
+#include <iterator>
+#include <bit>
+#include <cstdint>
+#include <concepts>
+
+
+/**
+ * @brief Reduce policies map a full hash to a bucket index of BasicBucketVector.
+ * resize rounds the requested bucket count to one the policy supports, and
+ * returns it. reduce is called on every insert, find and remove.
+ */
+
+namespace luna {
+
+
+template <class _Reduce>
+concept BucketReduceC = requires (_Reduce reduce, const _Reduce& creduce, size_t hash, index_t count) {
+    { reduce.resize(count) } -> std::convertible_to<index_t>;
+    { creduce.reduce(hash) } -> std::convertible_to<index_t>;
+};
+
+
+// any bucket count, with a runtime 64 bit modulo
+class ModuloReduce {
+public:
+
+    index_t resize (index_t count) {
+        _count = std::max(count, 1);
+        return _count;
+    }
+
+    index_t reduce (size_t hash) const {
+        return hash % _count;
+    }
+
+private:
+
+    size_t _count = 1;
+
+};
+
+
+// power of two bucket counts, taking the low bits of the hash as is.
+// only suitable for hashers that already mix their low bits well
+class MaskReduce {
+public:
+
+    index_t resize (index_t count) {
+        index_t rounded = std::bit_ceil((unsigned)std::max(count, 1));
+        _mask = rounded - 1;
+        return rounded;
+    }
+
+    index_t reduce (size_t hash) const {
+        return hash & _mask;
+    }
+
+private:
+
+    size_t _mask = 0;
+
+};
+
+
+// power of two bucket counts, multiplying by 2^64 / golden ratio and taking the high bits,
+// which spreads sequential and strided keys evenly
+class FibonacciReduce {
+public:
+
+    index_t resize (index_t count) {
+        index_t rounded = std::bit_ceil((unsigned)std::max(count, 2));
+        _shift = 64 - std::countr_zero((unsigned)rounded);
+        return rounded;
+    }
+
+    index_t reduce (size_t hash) const {
+        return ((uint64_t)hash * 11400714819323198485ull) >> _shift;
+    }
+
+private:
+
+    int _shift = 63;
+
+};
+
+
+// prime bucket counts from a fixed table, using Lemire's fastmod
+// (https://arxiv.org/abs/1902.01961) instead of a division.
+// the hash is folded to 32 bits first
+class PrimeReduce {
+public:
+
+    static constexpr uint32_t primes[] = {
+        5, 11, 23, 53, 97, 193, 389, 769, 1543, 3079, 6151, 12289, 24593,
+        49157, 98317, 196613, 393241, 786433, 1572869, 3145739, 6291469,
+        12582917, 25165843, 50331653, 100663319, 201326611, 402653189,
+        805306457, 1610612741
+    };
+
+    index_t resize (index_t count) {
+        const uint32_t* it = std::lower_bound(std::begin(primes), std::end(primes), (uint32_t)std::max(count, 1));
+        _count = it == std::end(primes) ? primes[std::size(primes) - 1] : *it;
+        _fastmod = UINT64_C(0xFFFFFFFFFFFFFFFF) / _count + 1;
+        return _count;
+    }
+
+    index_t reduce (size_t hash) const {
+        uint32_t folded = (uint32_t)((uint64_t)hash ^ ((uint64_t)hash >> 32));
+#ifdef __SIZEOF_INT128__
+        uint64_t low = _fastmod * folded;
+        return ((__uint128_t)low * _count) >> 64;
+#else
+        return folded % _count;
+#endif
+    }
+
+private:
+
+    uint64_t _fastmod = 1;
+    uint32_t _count = 1;
+
+};
+
+
+
+} // namespace luna
@@ -3,6 +3,7 @@
 #include "memory.h"
 #include <memory>
 #include <iterator>
+#include <concepts>
 #include "vector.h"
 #include "iterator-utils.h"
 
@@ -11,14 +12,48 @@ namespace luna {
     
 
 
-class RemoveChain {
+// removed elements link to the next one removed before them, valid ones hold nullindex.
+// a chain whose chunk resumes with elements, like MmapArrayChunk, recovers its root and count
+template <ArrayChunk _ChainChunk = HeapArrayChunk<index_t>>
+class BasicRemoveChain {
 public:
 
     using size_type = index_t;
     using value_type = size_type;
 
+    template <ArrayChunk _OtherChunk>
+    friend class BasicRemoveChain;
+
+    BasicRemoveChain () {
+        if (_chain.size() > 0) {
+            _resume();
+        }
+    }
+
+    BasicRemoveChain (const BasicRemoveChain&) = default;
+    BasicRemoveChain (BasicRemoveChain&&) = default;
+    BasicRemoveChain& operator= (const BasicRemoveChain&) = default;
+    BasicRemoveChain& operator= (BasicRemoveChain&&) = default;
+
+    template <ArrayChunk _OtherChunk>
+    BasicRemoveChain& operator= (const BasicRemoveChain<_OtherChunk>& other) {
+        _remove_count = other._remove_count;
+        _chain = other._chain;
+        _root = other._root;
+        return *this;
+    }
+
     void clear () {
         _chain.clear();
+        _remove_count = 0;
+        _root = tombstone;
+    }
+
+    // count valid elements and no removed ones, releasing any excess memory
+    void reset (size_type count) {
+        clear();
+        _chain.resize(count, nullindex);
+        _chain.shrink_to_fit();
     }
 
     size_type push () {
@@ -59,12 +94,43 @@ public:
 
 private:
 
+    // the root is the only removed element no other one links to
+    void _resume () {
+        Vector<uint8_t> linked(_chain.size(), 0);
+        for (size_type i = 0; i < _chain.size(); i++) {
+            if (_chain[i] != nullindex) {
+                _remove_count++;
+                if (_chain[i] != tombstone) {
+                    linked[_chain[i]] = 1;
+                }
+            }
+        }
+        for (size_type i = 0; i < _chain.size(); i++) {
+            if (_chain[i] != nullindex && !linked[i]) {
+                _root = i;
+                break;
+            }
+        }
+    }
+
     size_type _remove_count = 0;
-    Vector<value_type> _chain;
+    BasicVector<_ChainChunk> _chain;
     size_type _root = tombstone;
 
 };
 
+using RemoveChain = BasicRemoveChain<>;
+
+// the chunk a BasicDenseVector of _Chunk keeps its remove chain in, on the heap
+// unless the elements outlive the container
+template <class _Chunk>
+struct remove_chain_chunk {
+    using type = HeapArrayChunk<index_t>;
+};
+
+template <class _Chunk>
+using remove_chain_chunk_t = typename remove_chain_chunk<_Chunk>::type;
+
 
 template <class It>
 class RemoveChainValueIterator {
@@ -78,8 +144,14 @@ public:
 
     constexpr RemoveChainValueIterator () {}
 
+    // skips any leading removed elements
     constexpr RemoveChainValueIterator (It __it, size_type* __chain_ptr, size_type* __chain_end)
-    : _it(__it), _chain_ptr(__chain_ptr), _chain_end(__chain_end) {}
+    : _it(__it), _chain_ptr(__chain_ptr), _chain_end(__chain_end) {
+        while (_chain_ptr != _chain_end && *_chain_ptr != nullindex) {
+            _it++;
+            _chain_ptr++;
+        }
+    }
 
     constexpr reference operator* () const { return *_it; }
     constexpr pointer operator-> () const { return _it; }
@@ -88,7 +160,7 @@ public:
         do {
             _it++;
             _chain_ptr++;
-        } while (*_chain_ptr != nullindex && _chain_ptr != _chain_end);
+        } while (_chain_ptr != _chain_end && *_chain_ptr != nullindex);
         return *this;
     }
     constexpr RemoveChainValueIterator operator++ (int) {
@@ -101,7 +173,7 @@ public:
         do {
             _it--;
             _chain_ptr--;
-        } while (*_chain_ptr != nullindex && _chain_ptr != _chain_end);
+        } while (*_chain_ptr != nullindex);
         return *this;
     }
     constexpr RemoveChainValueIterator operator-- (int) {
@@ -136,14 +208,14 @@ template <class T>
 auto make_remove_chain_view (T& container, index_t* __chain_ptr, index_t* __chain_end) {
     return std::ranges::subrange{
         make_remove_chain_iterator(container.begin(), __chain_ptr, __chain_end),
-        make_remove_chain_iterator(container.end(), __chain_ptr, __chain_end)
+        make_remove_chain_iterator(container.end(), __chain_end, __chain_end)
     };
 }
 template <class T>
 auto make_remove_chain_view (const T& container, index_t* __chain_ptr, index_t* __chain_end) {
     return std::ranges::subrange{
         make_remove_chain_iterator(container.begin(), __chain_ptr, __chain_end),
-        make_remove_chain_iterator(container.end(), __chain_ptr, __chain_end)
+        make_remove_chain_iterator(container.end(), __chain_end, __chain_end)
     };
 }
 
@@ -171,7 +243,7 @@ public:
         return iterator(make_ipair_iterator(0, _begin_it), _chain_ptr, _chain_end);
     }
     iterator end () {
-        return iterator(make_ipair_iterator(nullindex, _end_it), _chain_ptr, _chain_end);
+        return iterator(make_ipair_iterator(nullindex, _end_it), _chain_end, _chain_end);
     }
 
 private:
@@ -184,6 +256,8 @@ private:
 };
 
 
+// moves relocate, like UninitializedMove. removed slots hold no element,
+// so they are skipped, unless the whole range can be relocated as bytes
 template <class T>
 struct RemoveChainUninitializedMove {
     using size_type = index_t;
@@ -192,9 +266,14 @@ struct RemoveChainUninitializedMove {
     _ForwardIt move (_InputIt first, _InputIt last, _ForwardIt result) const {
         size_type size = last - first; 
         _ForwardIt result_end = result + size;
+        if constexpr (is_trivially_relocatable_v<T>) {
+            relocate(std::to_address(first), std::to_address(last), std::to_address(result));
+            return result_end;
+        }
         for (size_type i = 0; i < size; i++) {
             if (_remove_chain[i] == nullindex) {
                 new(result) T(std::move(*first));
+                first->~T();
             }
             result++;
             first++;
@@ -216,16 +295,17 @@ struct RemoveChainUninitializedMove {
         return result_end;
     }
     
-    size_type* _remove_chain;
+    const size_type* _remove_chain;
 };
 
 
 
-template <ArrayChunk _Chunk>
+template <ArrayChunk _Chunk, GrowthPolicyC _Growth = DefaultGrowth>
 class BasicDenseVector {
 public:
 
     using pool_type = PushArrayChunk<_Chunk>;
+    using growth_type = _Growth;
     using value_type = typename pool_type::value_type;
     using size_type = index_t;  
     using index_type = Index<value_type>;
@@ -235,6 +315,7 @@ public:
     using reverse_iterator = std::reverse_iterator<iterator>;
     using const_reverse_iterator = std::reverse_iterator<const_iterator>;
     using allocator = pool_type::allocator;
+    using remove_chain_type = BasicRemoveChain<remove_chain_chunk_t<_Chunk>>;
 
     // template <
     //     class __Key,
@@ -244,49 +325,79 @@ public:
     //     GenericChunkC<__Key, __Val, index_t> __GenericChunk>
     // friend class Map;
 
-    BasicDenseVector () {}
+    // a chunk resuming with elements, like MmapArrayChunk, resumes its remove chain
+    // along with them, and one without a matching chain brings no removed slot back
+    BasicDenseVector () {
+        if (_removed.full_size() != _pool.size()) {
+            _removed.reset(_pool.size());
+        }
+    }
+
+    template <ArrayChunk _OtherChunk, GrowthPolicyC _OtherGrowth>
+    friend class BasicDenseVector;
 
-    template <ArrayChunkTypeC<value_type> _OtherPool>
-    BasicDenseVector (const BasicDenseVector<_OtherPool>& other) {
-        reserve(other.capacity());
-        _pool.push_back(other._pool.size());
-        _get_mv().copy(other.begin(), other.end(), _pool.begin());
+    BasicDenseVector (const BasicDenseVector& other) {
+        _copy_from(other);
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherPool>
-    BasicDenseVector (BasicDenseVector<_OtherPool>&& other) {
-        reserve(other.capacity());
-        _pool.push_back(other._pool.size());
-        _get_mv().move(other.begin(), other.end(), _pool.begin());
+    template <ArrayChunkTypeC<value_type> _OtherPool, class _OtherGrowth>
+    BasicDenseVector (const BasicDenseVector<_OtherPool, _OtherGrowth>& other) {
+        _copy_from(other);
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherPool>
-    BasicDenseVector& operator= (const BasicDenseVector<_OtherPool>& other) {
-        reserve(other.capacity());
-        _pool.push_back(other._pool.size());
-        _get_mv().copy(other.begin(), other.end(), _pool.begin());
+    BasicDenseVector (BasicDenseVector&& other) {
+        _move_from(std::move(other));
+    }
+
+    template <ArrayChunkTypeC<value_type> _OtherPool, class _OtherGrowth>
+    BasicDenseVector (BasicDenseVector<_OtherPool, _OtherGrowth>&& other) {
+        _move_from(std::move(other));
+    }
+
+    BasicDenseVector& operator= (const BasicDenseVector& other) {
+        if (this != &other) {
+            clear();
+            _copy_from(other);
+        }
+        return *this;
+    }
+
+    template <ArrayChunkTypeC<value_type> _OtherPool, class _OtherGrowth>
+    BasicDenseVector& operator= (const BasicDenseVector<_OtherPool, _OtherGrowth>& other) {
+        clear();
+        _copy_from(other);
         return *this;
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherPool>
-    BasicDenseVector& operator= (BasicDenseVector<_OtherPool>&& other) {
-        reserve(other.capacity());
-        _pool.push_back(other._pool.size());
-        _get_mv().move(other.begin(), other.end(), _pool.begin());
+    BasicDenseVector& operator= (BasicDenseVector&& other) {
+        if (this != &other) {
+            clear();
+            _pool.deallocate();
+            _move_from(std::move(other));
+        }
+        return *this;
+    }
+
+    template <ArrayChunkTypeC<value_type> _OtherPool, class _OtherGrowth>
+    BasicDenseVector& operator= (BasicDenseVector<_OtherPool, _OtherGrowth>&& other) {
+        clear();
+        _pool.deallocate();
+        _move_from(std::move(other));
         return *this;
     }
 
     ~BasicDenseVector () {
         _destroy_elts();
+        _pool.deallocate();
     }
 
 
     template <class... _Args>
     index_type emplace_back (_Args&&... args) {
         index_type index = _removed.push();
-        if (index == _removed.size() - 1) {
+        if (index == _pool.size()) {
             if (_pool.is_full()) {
-                _pool.reserve_move(std::max(_pool.size() * 2, 1));
+                _pool.reserve_move(_Growth::grow(_pool.capacity(), sizeof(value_type)));
             }
             _pool.push_back();
         }
@@ -310,6 +421,38 @@ public:
             _pool.reserve_move(count, _get_mv());
     }
 
+    // moves the elements down over the removed ones, keeping their order,
+    // and releases the memory past them. calls fn(old_index, new_index) for
+    // every element in order, so indexes held elsewhere can be fixed up
+    template <class _Fn>
+    void compact (_Fn&& fn) {
+        size_type count = 0;
+        for (size_type i = 0; i < full_size();) {
+            if (!_removed.is_valid(i)) {
+                i++;
+                continue;
+            }
+            // each run of valid elements is relocated at once
+            size_type run = i;
+            while (i < full_size() && _removed.is_valid(i)) {
+                i++;
+            }
+            if (run != count) {
+                relocate(_pool.begin() + run, _pool.begin() + i, _pool.begin() + count);
+            }
+            for (size_type j = run; j < i; j++) {
+                fn((index_type)j, (index_type)count++);
+            }
+        }
+        _pool.set_size(count);
+        _pool.shrink_move();
+        _removed.reset(count);
+    }
+
+    void compact () {
+        compact([](index_type, index_type) {});
+    }
+
     void clear () {
         _destroy_elts();
         _pool.clear();
@@ -324,7 +467,9 @@ public:
 
     size_type size () const { return _removed.size(); }
     size_type full_size () const { return _removed.full_size(); }
+    size_type capacity () const { return _pool.capacity(); }
     bool is_full () const { return _removed.is_full(); }
+    bool is_valid (index_type index) const { return _removed.is_valid(index); }
 
     iterator begin () { return iterator(_pool.begin(), _removed.begin(), _removed.end()); }
     iterator end () { return iterator(_pool.end(), _removed.end(), _removed.end()); }
@@ -364,18 +509,54 @@ private:
         }
     }
 
-    RemoveChainUninitializedMove<value_type> _get_mv () {
+    RemoveChainUninitializedMove<value_type> _get_mv () const {
         return RemoveChainUninitializedMove<value_type>{ _removed.begin() };
     }
 
+    template <ArrayChunkTypeC<value_type> _OtherPool, class _OtherGrowth>
+    void _copy_from (const BasicDenseVector<_OtherPool, _OtherGrowth>& other) {
+        reserve(other.full_size());
+        _pool.push_back(other.full_size());
+        other._get_mv().copy(other._pool.begin(), other._pool.end(), _pool.begin());
+        _removed = other._removed;
+    }
+
+    // expects this to be empty, and leaves other empty
+    template <ArrayChunkTypeC<value_type> _OtherPool, class _OtherGrowth>
+    void _move_from (BasicDenseVector<_OtherPool, _OtherGrowth>&& other) {
+        if constexpr (std::same_as<_OtherPool, _Chunk> && is_trivially_relocatable_v<pool_type>) {
+            std::swap(_pool, other._pool);
+        } else {
+            reserve(other.full_size());
+            _pool.push_back(other.full_size());
+            other._get_mv().move(other._pool.begin(), other._pool.end(), _pool.begin());
+            other._pool.clear();
+            other._pool.deallocate();
+        }
+        if constexpr (std::same_as<remove_chain_type, typename BasicDenseVector<_OtherPool, _OtherGrowth>::remove_chain_type>) {
+            std::swap(_removed, other._removed);
+        } else {
+            _removed = other._removed;
+            other._removed.clear();
+        }
+    }
+
     pool_type _pool;
-    RemoveChain _removed;
+    remove_chain_type _removed;
 
 };
 
 
-template <class T, class _Alloc = std::allocator<T>>
-using DenseVector = BasicDenseVector<HeapArrayChunk<T, _Alloc>>;
+template <ArrayChunk _ChainChunk>
+struct is_trivially_relocatable<BasicRemoveChain<_ChainChunk>> : is_trivially_relocatable<PushArrayChunk<_ChainChunk>> {};
+
+template <ArrayChunk _Chunk, GrowthPolicyC _Growth>
+struct is_trivially_relocatable<BasicDenseVector<_Chunk, _Growth>> : std::conjunction<
+    is_trivially_relocatable<PushArrayChunk<_Chunk>>,
+    is_trivially_relocatable<typename BasicDenseVector<_Chunk, _Growth>::remove_chain_type>> {};
+
+template <class T, class _Alloc = std::allocator<T>, GrowthPolicyC _Growth = DefaultGrowth>
+using DenseVector = BasicDenseVector<HeapArrayChunk<T, _Alloc>, _Growth>;
 
 
 static_assert(UnorderedVectorC<DenseVector<int>>);
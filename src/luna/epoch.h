@@ -0,0 +1,184 @@
+#pragma once
+#include "index.h"
+#include "vector.h"
+#include "array.h"
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <cassert>
+
+
+namespace luna {
+
+
+
+/**
+ * @brief Epoch based reclamation, so memory that readers may still be walking
+ * is only freed once none of them can hold a pointer into it.
+ * A reader thread registers once, claiming one of _MaxReaders slots, and pins the
+ * domain around each read by storing the global epoch in its slot, followed by a
+ * fence. Pinning and unpinning are plain stores, so readers never take a lock,
+ * never write a shared cache line and never do an atomic read-modify-write.
+ * Writers unlink memory first, then retire it, which advances the epoch. Memory
+ * retired at epoch e is freed once every pinned slot holds a later epoch.
+ */
+template <index_t _MaxReaders = 128>
+class BasicEpochDomain {
+
+    // each slot on its own cache line, so readers never share one
+    struct alignas(64) Slot {
+        // 0 while the reader is not pinned
+        std::atomic<uint64_t> epoch = 0;
+        std::atomic<bool> claimed = false;
+    };
+
+public:
+
+    using size_type = index_t;
+
+    static constexpr size_type max_readers = _MaxReaders;
+
+    class Reader;
+
+    // keeps the domain pinned for as long as it lives, pins nest
+    class Guard {
+    public:
+
+        explicit Guard (Reader& __reader) : _reader(__reader) { _reader.pin(); }
+        ~Guard () { _reader.unpin(); }
+
+        Guard (const Guard&) = delete;
+        Guard& operator= (const Guard&) = delete;
+
+    private:
+
+        Reader& _reader;
+
+    };
+
+    // the registration of one reader thread, which must not be shared between threads
+    class Reader {
+    public:
+
+        explicit Reader (BasicEpochDomain& __domain)
+        : _domain(__domain), _slot(__domain._claim()) {}
+
+        ~Reader () {
+            assert(_depth == 0);
+            _slot->claimed.store(false, std::memory_order_release);
+        }
+
+        Reader (const Reader&) = delete;
+        Reader& operator= (const Reader&) = delete;
+
+        // the fence orders the slot store before every read of shared pointers that follows.
+        // a writer that misses the store is then guaranteed to have its unlinks seen
+        void pin () {
+            if (_depth++ > 0) return;
+            _slot->epoch.store(_domain._epoch.load(std::memory_order_acquire), std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+
+        void unpin () {
+            assert(_depth > 0);
+            if (--_depth > 0) return;
+            _slot->epoch.store(0, std::memory_order_release);
+        }
+
+        Guard guard () { return Guard(*this); }
+
+        BasicEpochDomain& domain () const { return _domain; }
+
+    private:
+
+        BasicEpochDomain& _domain;
+        Slot* _slot;
+        size_type _depth = 0;
+
+    };
+
+    BasicEpochDomain () = default;
+
+    BasicEpochDomain (const BasicEpochDomain&) = delete;
+    BasicEpochDomain& operator= (const BasicEpochDomain&) = delete;
+
+    // no reader may be pinned anymore, so everything still retired is freed
+    ~BasicEpochDomain () {
+        for (const Retired& retired : _retired) {
+            retired.free(retired.ptr);
+        }
+    }
+
+    // ptr must already be unreachable for readers that pin from now on
+    void retire (void* ptr, void (*free)(void*)) {
+        std::lock_guard lock(_mutex);
+        uint64_t epoch = _epoch.fetch_add(1, std::memory_order_seq_cst);
+        _retired.push_back(Retired{ ptr, free, epoch });
+    }
+
+    template <class T>
+    void retire (T* ptr) {
+        retire(ptr, [](void* p) { delete (T*)p; });
+    }
+
+    // frees what no pinned reader can see, returns how many retired pointers are left
+    size_type reclaim () {
+        std::lock_guard lock(_mutex);
+        if (_retired.size() == 0) return 0;
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        uint64_t oldest = UINT64_MAX;
+        for (const Slot& slot : _slots) {
+            uint64_t epoch = slot.epoch.load(std::memory_order_acquire);
+            if (epoch != 0) {
+                oldest = std::min(oldest, epoch);
+            }
+        }
+        // a reader pinned at epoch e may hold anything retired at e or later
+        size_type kept = 0;
+        for (size_type i = 0; i < _retired.size(); i++) {
+            Retired retired = _retired[i];
+            if (retired.epoch < oldest) {
+                retired.free(retired.ptr);
+            } else {
+                _retired[kept++] = retired;
+            }
+        }
+        _retired.resize(kept);
+        return kept;
+    }
+
+    uint64_t epoch () const { return _epoch.load(std::memory_order_relaxed); }
+
+private:
+
+    struct Retired {
+        void* ptr;
+        void (*free)(void*);
+        uint64_t epoch;
+    };
+
+    Slot* _claim () {
+        for (Slot& slot : _slots) {
+            bool expected = false;
+            if (!slot.claimed.load(std::memory_order_relaxed)
+                && slot.claimed.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+                return &slot;
+            }
+        }
+        assert(false && "more readers than max_readers");
+        return nullptr;
+    }
+
+    // starts at 1, so 0 can mark unpinned slots
+    std::atomic<uint64_t> _epoch = 1;
+    Array<Slot, _MaxReaders> _slots;
+    std::mutex _mutex;
+    Vector<Retired> _retired;
+
+};
+
+using EpochDomain = BasicEpochDomain<>;
+
+
+
+} // namespace luna
@@ -0,0 +1,600 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "vector.h"
+#include "hash.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ranges>
+#include <type_traits>
+#include <cassert>
+
+
+/**
+ * @brief Read only sets and maps built once from a Set or Map, with a minimal perfect hash.
+ * Keys are spread over buckets of about 5, and each bucket gets a pilot, the first
+ * value whose mix with the key hashes sends every key of the bucket to a free slot.
+ * Buckets are placed largest first, over a table 3% larger than the key count,
+ * and the few keys landing past the end are sent to the free slots before it
+ * through a small remap array, as in PTHash (https://arxiv.org/abs/2104.10402).
+ * A lookup costs one hash, one pilot read, one slot read and one compare, and
+ * the keys are stored densely with no empty slots.
+ * The views read the same layout from any memory, like a buffer written by
+ * write_to, as long as keys and values are trivially copyable.
+ */
+
+namespace luna {
+
+
+
+// every number a lookup needs besides the arrays themselves
+struct FrozenLayout {
+    uint64_t seed = 0;
+    index_t size = 0;
+    index_t bucket_count = 0;
+    index_t table_size = 0;
+    index_t remap_count = 0;
+};
+
+
+inline size_t _frozen_align (size_t offset, size_t align) {
+    return (offset + align - 1) / align * align;
+}
+
+
+template <class T, HasherC<T> _Hasher = DefaultHasher<T>, CompareC<T, T> _Equal = BasicCmp<T>>
+class FrozenSetView {
+public:
+
+    using value_type = T;
+    using size_type = index_t;
+    using index_type = Index<T>;
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+    using pilot_type = uint16_t;
+
+    using iterator = const T*;
+    using const_iterator = const T*;
+
+    FrozenSetView () {}
+    FrozenSetView (const FrozenLayout& layout, const pilot_type* pilots, const index_t* remap, const T* keys)
+    : _layout(layout), _pilots(pilots), _remap(remap), _keys(keys) {}
+
+    // the view of a buffer written by write_to, which must outlive it
+    static FrozenSetView from_buffer (const void* buffer) requires std::is_trivially_copyable_v<T> {
+        const char* bytes = (const char*)buffer;
+        FrozenLayout layout;
+        std::memcpy(&layout, bytes, sizeof(layout));
+        return FrozenSetView(layout,
+            (const pilot_type*)(bytes + _pilots_offset()),
+            (const index_t*)(bytes + _remap_offset(layout)),
+            (const T*)(bytes + _keys_offset(layout)));
+    }
+
+    template <class _U>
+    index_type find_index (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        if (_layout.size == 0) return nullindex;
+        size_type slot = slot_of(__hasher.hash(key));
+        return __key_equal.cmp(_keys[slot], key) ? index_type(slot) : index_type(nullindex);
+    }
+
+    template <class _U>
+    const T* find (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        index_type index = find_index(key, __hasher, __key_equal);
+        return index == nullindex ? nullptr : _keys + index;
+    }
+
+    template <class _U>
+    bool contains (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return find_index(key, __hasher, __key_equal) != nullindex;
+    }
+
+    // the index the key with this hash would be at, if it is in the set at all
+    size_type slot_of (size_t hash) const {
+        uint64_t key_hash = _key_hash(hash, _layout.seed);
+        size_type slot = _slot(key_hash, _pilots[_bucket(key_hash, _layout.bucket_count)], _layout.table_size);
+        return slot < _layout.size ? slot : _remap[slot - _layout.size];
+    }
+
+    // the number of bytes write_to needs
+    size_t byte_size () const {
+        return _keys_offset(_layout) + sizeof(T) * _layout.size;
+    }
+
+    // writes the set to buffer, which must be aligned for both T and uint64_t
+    void write_to (void* buffer) const requires std::is_trivially_copyable_v<T> {
+        char* bytes = (char*)buffer;
+        std::memset(bytes, 0, byte_size());
+        std::memcpy(bytes, &_layout, sizeof(_layout));
+        if (_layout.size == 0) return;
+        std::memcpy(bytes + _pilots_offset(), _pilots, sizeof(pilot_type) * _layout.bucket_count);
+        std::memcpy(bytes + _remap_offset(_layout), _remap, sizeof(index_t) * _layout.remap_count);
+        std::memcpy(bytes + _keys_offset(_layout), _keys, sizeof(T) * _layout.size);
+    }
+
+    const T& at (index_type index) const { return _keys[index]; }
+    const T& operator[] (index_type index) const { return _keys[index]; }
+
+    const_iterator begin () const { return _keys; }
+    const_iterator end () const { return _keys + _layout.size; }
+
+    size_type size () const { return _layout.size; }
+    bool empty () const { return _layout.size == 0; }
+    const FrozenLayout& layout () const { return _layout; }
+
+    static uint64_t _key_hash (size_t hash, uint64_t seed) {
+        return hash_int(hash ^ seed);
+    }
+
+    // 60% of the keys go to the first 30% of the buckets, so that the buckets placed
+    // last, when the table is nearly full, are mostly small ones
+    static size_type _bucket (uint64_t key_hash, size_type bucket_count) {
+        constexpr uint64_t dense_share = (uint64_t)(0.6 * 4294967296.0);
+        uint64_t dense_count = (uint64_t)bucket_count * 3 / 10;
+        uint64_t low = (uint32_t)key_hash;
+        if ((key_hash >> 32) < dense_share) {
+            return (size_type)((low * dense_count) >> 32);
+        }
+        return (size_type)(dense_count + ((low * (bucket_count - dense_count)) >> 32));
+    }
+
+    static size_type _slot (uint64_t key_hash, pilot_type pilot, size_type table_size) {
+        uint64_t h = hash_int(key_hash ^ ((uint64_t)pilot * 0x9E3779B97F4A7C15ull));
+        return (size_type)(((h >> 32) * (uint64_t)table_size) >> 32);
+    }
+
+private:
+
+    static size_t _pilots_offset () {
+        return _frozen_align(sizeof(FrozenLayout), alignof(uint64_t));
+    }
+
+    static size_t _remap_offset (const FrozenLayout& layout) {
+        return _frozen_align(_pilots_offset() + sizeof(pilot_type) * layout.bucket_count, alignof(index_t));
+    }
+
+    static size_t _keys_offset (const FrozenLayout& layout) {
+        return _frozen_align(_remap_offset(layout) + sizeof(index_t) * layout.remap_count,
+            std::max(alignof(T), alignof(uint64_t)));
+    }
+
+    FrozenLayout _layout;
+    const pilot_type* _pilots = nullptr;
+    const index_t* _remap = nullptr;
+    const T* _keys = nullptr;
+
+};
+
+
+template <class T, HasherC<T> _Hasher = DefaultHasher<T>, CompareC<T, T> _Equal = BasicCmp<T>>
+class BasicFrozenSet {
+public:
+
+    using view_type = FrozenSetView<T, _Hasher, _Equal>;
+    using value_type = T;
+    using size_type = index_t;
+    using index_type = Index<T>;
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+    using pilot_type = typename view_type::pilot_type;
+
+    using iterator = const T*;
+    using const_iterator = const T*;
+
+    // keys per bucket, and the share of the table left free for the last buckets to land in
+    static constexpr size_type bucket_size = 5;
+    static constexpr size_type free_slots = 32;
+    // seeds tried before giving up, only distinct keys with equal hashes should ever exhaust them
+    static constexpr int max_attempts = 16;
+
+    BasicFrozenSet () {}
+
+    // leaves the set empty when build fails
+    template <std::ranges::input_range _Range>
+    explicit BasicFrozenSet (const _Range& keys, const _Hasher& __hasher = {}) {
+        build(keys, __hasher);
+    }
+
+    // replaces the contents with copies of any range of keys, dropping duplicates like a Set
+    template <std::ranges::input_range _Range>
+    bool build (const _Range& keys, const _Hasher& __hasher = {}) {
+        // copied first, as the range may yield temporaries
+        Vector<T> copies;
+        for (auto&& key : keys) {
+            copies.push_back(key);
+        }
+        Vector<index_t> order;
+        return build(copies, order, __hasher);
+    }
+
+    // replaces the contents with keys, moved out of the vector. A key equal to an earlier one
+    // is dropped, and order[i] is set to the position in keys of the key that ends up at index i.
+    // Fails, leaving the set empty and keys untouched, when distinct keys have equal hashes
+    bool build (Vector<T>& keys, Vector<index_t>& order, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        _layout = FrozenLayout{};
+        _pilots.clear();
+        _remap.clear();
+        _keys.clear();
+        order.clear();
+        if (keys.size() == 0) return true;
+
+        Vector<size_t> key_hashes;
+        key_hashes.reserve(keys.size());
+        for (const T& key : keys) {
+            key_hashes.push_back(__hasher.hash(key));
+        }
+        Vector<index_t> unique = _unique(keys, key_hashes, __key_equal);
+        size_type count = unique.size();
+        Vector<size_t> hashes;
+        hashes.reserve(count);
+        for (index_t i : unique) {
+            hashes.push_back(key_hashes[i]);
+        }
+
+        Vector<index_t> slots(count, nullindex);
+        uint64_t seed = 0;
+        bool placed = false;
+        for (int attempt = 0; attempt < max_attempts && !placed; attempt++) {
+            seed = hash_int(seed + attempt);
+            placed = _place(hashes, slots, seed);
+        }
+        if (!placed) {
+            _layout = FrozenLayout{};
+            _pilots.clear();
+            return false;
+        }
+
+        _layout.size = count;
+        _layout.seed = seed;
+        // keys past the end of the table move into the free slots before it, in order
+        size_type next_free = 0;
+        order.resize(count, nullindex);
+        for (size_type i = 0; i < count; i++) {
+            if (slots[i] < count) {
+                order[slots[i]] = i;
+            }
+        }
+        // slots no key took still point at a valid index, where a missing key fails its compare
+        _remap.resize(_layout.remap_count, 0);
+        for (size_type i = 0; i < count; i++) {
+            if (slots[i] >= count && slots[i] != nullindex) {
+                while (order[next_free] != nullindex) {
+                    next_free++;
+                }
+                _remap[slots[i] - count] = next_free;
+                order[next_free] = i;
+            }
+        }
+        _keys.reserve(count);
+        for (size_type i = 0; i < count; i++) {
+            order[i] = unique[order[i]];
+            _keys.push_back(std::move(keys[order[i]]));
+        }
+        return true;
+    }
+
+    view_type view () const {
+        return view_type(_layout, _pilots.data(), _remap.data(), _keys.data());
+    }
+
+    template <class _U>
+    index_type find_index (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return view().find_index(key, __hasher, __key_equal);
+    }
+
+    template <class _U>
+    const T* find (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return view().find(key, __hasher, __key_equal);
+    }
+
+    template <class _U>
+    bool contains (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return view().contains(key, __hasher, __key_equal);
+    }
+
+    size_t byte_size () const { return view().byte_size(); }
+    void write_to (void* buffer) const { view().write_to(buffer); }
+
+    const T& at (index_type index) const { return _keys[index]; }
+    const T& operator[] (index_type index) const { return _keys[index]; }
+
+    const_iterator begin () const { return _keys.begin(); }
+    const_iterator end () const { return _keys.end(); }
+
+    size_type size () const { return _layout.size; }
+    bool empty () const { return _layout.size == 0; }
+    size_type bucket_count () const { return _layout.bucket_count; }
+
+private:
+
+    // the positions of the keys not equal to an earlier one, in order.
+    // equal keys have equal hashes, so only keys sorted next to each other are compared
+    static Vector<index_t> _unique (const Vector<T>& keys, const Vector<size_t>& hashes, const _Equal& __key_equal) {
+        size_type count = keys.size();
+        Vector<index_t> by_hash(count);
+        for (size_type i = 0; i < count; i++) {
+            by_hash[i] = i;
+        }
+        std::sort(by_hash.begin(), by_hash.end(), [&](index_t a, index_t b) {
+            return hashes[a] != hashes[b] ? hashes[a] < hashes[b] : a < b;
+        });
+        Vector<uint8_t> dropped(count, 0);
+        for (size_type first = 0; first < count; ) {
+            size_type last = first + 1;
+            while (last < count && hashes[by_hash[last]] == hashes[by_hash[first]]) {
+                last++;
+            }
+            for (size_type i = first + 1; i < last; i++) {
+                for (size_type j = first; j < i; j++) {
+                    if (!dropped[by_hash[j]] && __key_equal.cmp(keys[by_hash[j]], keys[by_hash[i]])) {
+                        dropped[by_hash[i]] = 1;
+                        break;
+                    }
+                }
+            }
+            first = last;
+        }
+        Vector<index_t> unique;
+        unique.reserve(count);
+        for (size_type i = 0; i < count; i++) {
+            if (!dropped[i]) {
+                unique.push_back(i);
+            }
+        }
+        return unique;
+    }
+
+    // finds a pilot for every bucket, writing the table slot of every key to slots.
+    // fails if some bucket has no pilot sending all its keys to free slots
+    bool _place (const Vector<size_t>& hashes, Vector<index_t>& slots, uint64_t seed) {
+        size_type count = hashes.size();
+        size_type bucket_count = count / bucket_size + 1;
+        size_type table_size = count + count / free_slots + 1;
+        _layout.bucket_count = bucket_count;
+        _layout.table_size = table_size;
+        _layout.remap_count = table_size - count;
+
+        // keys sorted by bucket, and buckets sorted by size, largest first
+        Vector<uint64_t> key_hashes(count);
+        Vector<index_t> bucket_starts(bucket_count + 1, 0);
+        for (size_type i = 0; i < count; i++) {
+            key_hashes[i] = view_type::_key_hash(hashes[i], seed);
+            bucket_starts[view_type::_bucket(key_hashes[i], bucket_count) + 1]++;
+        }
+        size_type largest = 0;
+        for (size_type b = 0; b < bucket_count; b++) {
+            largest = std::max(largest, bucket_starts[b + 1]);
+            bucket_starts[b + 1] += bucket_starts[b];
+        }
+        Vector<index_t> bucket_keys(count);
+        {
+            Vector<index_t> next(bucket_count + 1);
+            std::copy(bucket_starts.begin(), bucket_starts.end(), next.begin());
+            for (size_type i = 0; i < count; i++) {
+                bucket_keys[next[view_type::_bucket(key_hashes[i], bucket_count)]++] = i;
+            }
+        }
+        Vector<index_t> size_starts(largest + 2, 0);
+        for (size_type b = 0; b < bucket_count; b++) {
+            size_starts[largest - (bucket_starts[b + 1] - bucket_starts[b]) + 1]++;
+        }
+        for (size_type s = 0; s <= largest; s++) {
+            size_starts[s + 1] += size_starts[s];
+        }
+        Vector<index_t> buckets(bucket_count);
+        for (size_type b = 0; b < bucket_count; b++) {
+            buckets[size_starts[largest - (bucket_starts[b + 1] - bucket_starts[b])]++] = b;
+        }
+
+        _pilots.clear();
+        _pilots.resize(bucket_count, 0);
+        // one bit per slot, so that the table being searched mostly stays in cache
+        Vector<uint64_t> taken((table_size + 63) / 64, 0);
+        auto is_taken = [&](size_type slot) { return (taken[slot >> 6] >> (slot & 63)) & 1; };
+        auto flip = [&](size_type slot) { taken[slot >> 6] ^= 1ull << (slot & 63); };
+        Vector<index_t> bucket_slots(largest);
+        for (size_type bucket : buckets) {
+            size_type first = bucket_starts[bucket];
+            size_type size = bucket_starts[bucket + 1] - first;
+            if (size == 0) break;
+            bool found = false;
+            for (uint32_t pilot = 0; pilot <= UINT16_MAX && !found; pilot++) {
+                found = true;
+                for (size_type k = 0; k < size; k++) {
+                    size_type slot = view_type::_slot(key_hashes[bucket_keys[first + k]], (pilot_type)pilot, table_size);
+                    if (is_taken(slot)) {
+                        // frees the slots of this bucket taken so far
+                        for (size_type j = 0; j < k; j++) {
+                            flip(bucket_slots[j]);
+                        }
+                        found = false;
+                        break;
+                    }
+                    flip(slot);
+                    bucket_slots[k] = slot;
+                }
+                if (found) {
+                    _pilots[bucket] = (pilot_type)pilot;
+                }
+            }
+            if (!found) return false;
+            for (size_type k = 0; k < size; k++) {
+                slots[bucket_keys[first + k]] = bucket_slots[k];
+            }
+        }
+        return true;
+    }
+
+    FrozenLayout _layout;
+    Vector<pilot_type> _pilots;
+    Vector<index_t> _remap;
+    Vector<T> _keys;
+
+};
+
+
+template <class K, class V, HasherC<K> _Hasher = DefaultHasher<K>, CompareC<K, K> _Equal = BasicCmp<K>>
+class FrozenMapView {
+public:
+
+    using set_view_type = FrozenSetView<K, _Hasher, _Equal>;
+    using key_type = K;
+    using value_type = V;
+    using size_type = index_t;
+    using index_type = Index<V>;
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+
+    FrozenMapView () {}
+    FrozenMapView (const set_view_type& __keys, const V* vals)
+    : _keys(__keys), _vals(vals) {}
+
+    // the view of a buffer written by write_to, which must outlive it
+    static FrozenMapView from_buffer (const void* buffer) requires std::is_trivially_copyable_v<V> {
+        set_view_type keys = set_view_type::from_buffer(buffer);
+        return FrozenMapView(keys, (const V*)((const char*)buffer + _vals_offset(keys)));
+    }
+
+    template <class _U>
+    const V* find (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        index_t index = _keys.find_index(key, __hasher, __key_equal);
+        return index == nullindex ? nullptr : _vals + index;
+    }
+
+    template <class _U>
+    const V& at (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        const V* val = find(key, __hasher, __key_equal);
+        assert(val);
+        return *val;
+    }
+
+    template <class _U>
+    bool contains (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return _keys.contains(key, __hasher, __key_equal);
+    }
+
+    size_t byte_size () const {
+        return _vals_offset(_keys) + sizeof(V) * _keys.size();
+    }
+
+    // writes the map to buffer, which must be aligned for K, V and uint64_t
+    void write_to (void* buffer) const requires std::is_trivially_copyable_v<V> {
+        char* bytes = (char*)buffer;
+        std::memset(bytes, 0, byte_size());
+        _keys.write_to(bytes);
+        if (_keys.empty()) return;
+        std::memcpy(bytes + _vals_offset(_keys), _vals, sizeof(V) * _keys.size());
+    }
+
+    const set_view_type& keys () const { return _keys; }
+    Span<const V> values () const { return Span<const V>(_vals, _keys.size()); }
+
+    const K& key_at (index_t index) const { return _keys[index]; }
+    const V& at_index (index_t index) const { return _vals[index]; }
+
+    size_type size () const { return _keys.size(); }
+    bool empty () const { return _keys.empty(); }
+
+private:
+
+    static size_t _vals_offset (const set_view_type& keys) {
+        return _frozen_align(keys.byte_size(), std::max(alignof(V), alignof(uint64_t)));
+    }
+
+    set_view_type _keys;
+    const V* _vals = nullptr;
+
+};
+
+
+template <class K, class V, HasherC<K> _Hasher = DefaultHasher<K>, CompareC<K, K> _Equal = BasicCmp<K>>
+class BasicFrozenMap {
+public:
+
+    using set_type = BasicFrozenSet<K, _Hasher, _Equal>;
+    using view_type = FrozenMapView<K, V, _Hasher, _Equal>;
+    using key_type = K;
+    using value_type = V;
+    using size_type = index_t;
+    using index_type = Index<V>;
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+
+    BasicFrozenMap () {}
+
+    // leaves the map empty when build fails
+    template <std::ranges::input_range _Range>
+    explicit BasicFrozenMap (const _Range& map, const _Hasher& __hasher = {}) {
+        build(map, __hasher);
+    }
+
+    // replaces the contents with copies of any range of key value pairs, keeping the first
+    // value of a repeated key. Fails like BasicFrozenSet::build
+    template <std::ranges::input_range _Range>
+    bool build (const _Range& map, const _Hasher& __hasher = {}) {
+        _vals.clear();
+        // copied first, as the range may yield temporaries
+        Vector<K> keys;
+        Vector<V> vals;
+        for (auto&& [key, val] : map) {
+            keys.push_back(key);
+            vals.push_back(val);
+        }
+        Vector<index_t> order;
+        if (!_keys.build(keys, order, __hasher)) return false;
+        _vals.reserve(order.size());
+        for (index_t i : order) {
+            _vals.push_back(std::move(vals[i]));
+        }
+        return true;
+    }
+
+    view_type view () const {
+        return view_type(_keys.view(), _vals.data());
+    }
+
+    template <class _U>
+    const V* find (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return view().find(key, __hasher, __key_equal);
+    }
+
+    template <class _U>
+    const V& at (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return view().at(key, __hasher, __key_equal);
+    }
+
+    template <class _U>
+    bool contains (const _U& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return _keys.contains(key, __hasher, __key_equal);
+    }
+
+    size_t byte_size () const { return view().byte_size(); }
+    void write_to (void* buffer) const { view().write_to(buffer); }
+
+    const set_type& keys () const { return _keys; }
+    Span<const V> values () const { return Span<const V>(_vals.data(), _vals.size()); }
+
+    const K& key_at (index_t index) const { return _keys[index]; }
+    const V& at_index (index_t index) const { return _vals[index]; }
+
+    size_type size () const { return _keys.size(); }
+    bool empty () const { return _keys.empty(); }
+
+private:
+
+    set_type _keys;
+    Vector<V> _vals;
+
+};
+
+
+template <class T, HasherC<T> _Hasher = DefaultHasher<T>, CompareC<T, T> _Equal = BasicCmp<T>>
+using FrozenSet = BasicFrozenSet<T, _Hasher, _Equal>;
+
+template <class K, class V, HasherC<K> _Hasher = DefaultHasher<K>, CompareC<K, K> _Equal = BasicCmp<K>>
+using FrozenMap = BasicFrozenMap<K, V, _Hasher, _Equal>;
+
+
+
+} // namespace luna
@@ -0,0 +1,194 @@
+#pragma once
+#include "index.h"
+#include "string.h"
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+
+/**
+ * @brief Hashers that mix their output, unlike std::hash, which libstdc++
+ * implements as the identity for integers. Integers go through a single
+ * folded 64x64 -> 128 bit multiply. Byte strings use a wyhash/rapidhash style
+ * function, reading 8 bytes at a time and multiplying lanes independently.
+ * DefaultHasher stays BasicHasher everywhere, so every translation unit sees the
+ * same types. Another hasher is selected through the _Hasher parameter of a
+ * container, and FastSet and FastMap are the set and map aliases using FastHasher.
+ */
+
+namespace luna {
+
+
+
+namespace hash_detail {
+
+inline constexpr uint64_t secret[6] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull,
+    0x4d5a2da51de1aa47ull, 0xa0761d6478bd642full, 0xe7037ed1a0b428dbull
+};
+
+// the full 128 bit product of a and b, low half in a and high half in b
+inline void mum (uint64_t& a, uint64_t& b) {
+#ifdef __SIZEOF_INT128__
+    __uint128_t r = (__uint128_t)a * b;
+    a = (uint64_t)r;
+    b = (uint64_t)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    a = _umul128(a, b, &b);
+#else
+    uint64_t ha = a >> 32, hb = b >> 32, la = (uint32_t)a, lb = (uint32_t)b;
+    uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    uint64_t t = rl + (rm0 << 32);
+    uint64_t c = t < rl;
+    uint64_t lo = t + (rm1 << 32);
+    c += lo < t;
+    a = lo;
+    b = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+#endif
+}
+
+// the 128 bit product folded back to 64 bits
+inline uint64_t mix (uint64_t a, uint64_t b) {
+    mum(a, b);
+    return a ^ b;
+}
+
+// reads are little endian on every platform luna targets
+inline uint64_t read64 (const uint8_t* p) {
+    uint64_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+inline uint64_t read32 (const uint8_t* p) {
+    uint32_t v;
+    std::memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+} // namespace hash_detail
+
+
+inline uint64_t hash_int (uint64_t val) {
+    using namespace hash_detail;
+    return mix(val ^ secret[0], secret[1]);
+}
+
+
+// hashes len bytes at data. inputs of up to 16 bytes take no loop at all,
+// longer ones are consumed 48 bytes at a time over 3 independent lanes,
+// and from 256 bytes on 96 bytes at a time over 6, so the multiplies overlap
+inline uint64_t hash_bytes (const void* data, size_t len, uint64_t seed = 0) {
+    using namespace hash_detail;
+    const uint8_t* p = (const uint8_t*)data;
+    seed ^= mix(seed ^ secret[0], secret[1]) ^ len;
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            const uint8_t* last = p + len - 4;
+            size_t delta = (len & 24) >> (len >> 3);
+            a = (read32(p) << 32) | read32(last);
+            b = (read32(p + delta) << 32) | read32(last - delta);
+        } else if (len > 0) {
+            a = ((uint64_t)p[0] << 56) | ((uint64_t)p[len >> 1] << 32) | p[len - 1];
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        size_t i = len;
+        if (i > 48) {
+            uint64_t see1 = seed, see2 = seed;
+            if (i >= 256) {
+                uint64_t see3 = seed, see4 = seed, see5 = seed;
+                do {
+                    seed = mix(read64(p) ^ secret[0], read64(p + 8) ^ seed);
+                    see1 = mix(read64(p + 16) ^ secret[1], read64(p + 24) ^ see1);
+                    see2 = mix(read64(p + 32) ^ secret[2], read64(p + 40) ^ see2);
+                    see3 = mix(read64(p + 48) ^ secret[3], read64(p + 56) ^ see3);
+                    see4 = mix(read64(p + 64) ^ secret[4], read64(p + 72) ^ see4);
+                    see5 = mix(read64(p + 80) ^ secret[5], read64(p + 88) ^ see5);
+                    p += 96;
+                    i -= 96;
+                } while (i >= 96);
+                seed ^= see3;
+                see1 ^= see4;
+                see2 ^= see5;
+            }
+            while (i >= 48) {
+                seed = mix(read64(p) ^ secret[0], read64(p + 8) ^ seed);
+                see1 = mix(read64(p + 16) ^ secret[1], read64(p + 24) ^ see1);
+                see2 = mix(read64(p + 32) ^ secret[2], read64(p + 40) ^ see2);
+                p += 48;
+                i -= 48;
+            }
+            seed ^= see1 ^ see2;
+        }
+        if (i > 16) {
+            seed = mix(read64(p) ^ secret[2], read64(p + 8) ^ seed ^ secret[1]);
+            if (i > 32) {
+                seed = mix(read64(p + 16) ^ secret[2], read64(p + 24) ^ seed);
+            }
+        }
+        // the last 16 bytes, overlapping what was already read if need be
+        a = read64(p + i - 16);
+        b = read64(p + i - 8);
+    }
+    a ^= secret[1];
+    b ^= seed;
+    mum(a, b);
+    return mix(a ^ secret[0] ^ len, b ^ secret[1]);
+}
+
+
+// integers, enums and pointers are mixed directly, anything else mixes its std::hash
+template <class T>
+struct FastHasher {
+    static size_t hash (const T& val) {
+        if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            return hash_int((uint64_t)val);
+        } else if constexpr (std::is_pointer_v<T>) {
+            return hash_int((uint64_t)(uintptr_t)val);
+        } else {
+            return hash_int(std::hash<T>{}(val));
+        }
+    }
+};
+
+template <>
+struct FastHasher<std::string_view> {
+    static size_t hash (std::string_view str) {
+        return hash_bytes(str.data(), str.size());
+    }
+};
+
+// also takes string_views, so lookups do not need to build a string, see BasicCmp<std::string> in index.h
+template <>
+struct FastHasher<std::string> {
+    static size_t hash (std::string_view str) {
+        return hash_bytes(str.data(), str.size());
+    }
+};
+
+template <index_t _Sz, class T>
+struct FastHasher<BufferString<_Sz, T>> {
+    static size_t hash (const BufferString<_Sz, T>& str) {
+        return hash_bytes(str.data(), std::min(str.length(), str.capacity()) * sizeof(T));
+    }
+};
+
+
+// the hasher of every container unless its _Hasher parameter says otherwise
+template <class T>
+using DefaultHasher = BasicHasher<T>;
+
+
+
+} // namespace luna
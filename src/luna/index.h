@@ -1,6 +1,8 @@
 #pragma once
 #include <cassert>
 #include <iostream>
+#include <string>
+#include <string_view>
 
 
 using index_t = int;
@@ -138,11 +140,11 @@ public:
     constexpr const T& back () const { return *(_end - 1); }
 
     T& at (index_type index) {
-        ASSERT_IN_RANGE(index, 0, size() - 1);
+        ASSERT_IN_RANGE((size_type)index, 0, size() - 1);
         return _begin[index];
     }
     const T& at (index_type index) const {
-        ASSERT_IN_RANGE(index, 0, size() - 1);
+        ASSERT_IN_RANGE((size_type)index, 0, size() - 1);
         return _begin[index];
     }
     T& operator[] (index_type index) { return at(index); }
@@ -213,11 +215,29 @@ struct BasicCmp {
         return a == b;
     }
 };
+// compares strings with string_views, for lookups with a hasher taking them too, see FastHasher
+template <>
+struct BasicCmp<std::string> {
+    static bool cmp (std::string_view a, std::string_view b) {
+        return a == b;
+    }
+};
 template <class _Cmp, class T, class U>
 concept CompareC = requires (const _Cmp& cmp, const T& a, const U& b) {
     { cmp.cmp(a, b) } -> std::convertible_to<bool>;
 };
 
+template <class T, class U = T>
+struct BasicLess {
+    static bool less (const T& a, const U& b) {
+        return a < b;
+    }
+};
+template <class _Less, class T, class U>
+concept LessC = requires (const _Less& less, const T& a, const U& b) {
+    { less.less(a, b) } -> std::convertible_to<bool>;
+};
+
 
 } // namespace luna
 
@@ -1,5 +1,6 @@
 #pragma once
 #include "set.h"
+#include <type_traits>
 
 
 
@@ -13,10 +14,11 @@ public:
 
     // using size_type = index_t;
     // using index_type = Index<base_value_type>;
-    using value_type = std::pair<_Key, _Val>;
+    using value_type = std::pair<std::remove_const_t<_Key>, std::remove_const_t<_Val>>;
     using reference = std::pair<const _Key&, _Val&>;
     using pointer = _Val*;
     using difference_type = std::ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
 
     constexpr BasicMapIterator (_Key* __key = nullptr, _Val* __val = nullptr)
     : _key(__key), _val(__val) {}
@@ -71,13 +73,151 @@ template <class _Key, class _Val>
 using MapIterator = RemoveChainValueIterator<BasicMapIterator<_Key, _Val>>;
 
 
+enum class MapLayout {
+    // keys and values in two dense vectors, so walking the keys never touches the values
+    separate,
+    // each key next to its value in a single dense vector, so a lookup that
+    // compared the key usually finds the value on the same cache line
+    interleaved,
+};
+
+
+// the element of a map with the interleaved layout
+template <class _Key, class _Val>
+struct MapEntry {
+    template <class... _Args>
+    MapEntry (const _Key& __key, _Args&&... args)
+    : key(__key), value(std::forward<_Args>(args)...) {}
+
+    _Key key;
+    _Val value;
+};
+
+template <class T>
+struct IsMapEntry : std::false_type {};
+template <class _Key, class _Val>
+struct IsMapEntry<MapEntry<_Key, _Val>> : std::true_type {};
+
+// the key of an entry, or the value itself if it is not an entry
+template <class T>
+constexpr const auto& entry_key (const T& val) {
+    if constexpr (IsMapEntry<T>::value) {
+        return val.key;
+    } else {
+        return val;
+    }
+}
+
+// hashes and compares entries by their key, and keys as they are
+template <class _Hasher>
+struct EntryHasher {
+    EntryHasher (const _Hasher& __hasher = {}) : hasher(__hasher) {}
+
+    template <class _T>
+    size_t hash (const _T& val) const {
+        return hasher.hash(entry_key(val));
+    }
+
+    [[no_unique_address]] _Hasher hasher;
+};
+
+template <class _Equal>
+struct EntryEqual {
+    EntryEqual (const _Equal& __equal = {}) : equal(__equal) {}
+
+    template <class _T, class _U>
+    bool cmp (const _T& a, const _U& b) const {
+        return equal.cmp(entry_key(a), entry_key(b));
+    }
+
+    [[no_unique_address]] _Equal equal;
+};
+
+
+template <class _Entry>
+class BasicMapEntryIterator {
+public:
+
+    using key_type = decltype(std::declval<_Entry&>().key);
+    using mapped_type = std::conditional_t<std::is_const_v<_Entry>,
+        const decltype(std::declval<_Entry&>().value),
+        decltype(std::declval<_Entry&>().value)>;
+
+    using value_type = std::pair<key_type, std::remove_const_t<mapped_type>>;
+    using reference = std::pair<const key_type&, mapped_type&>;
+    using pointer = mapped_type*;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+
+    constexpr BasicMapEntryIterator (_Entry* __entry = nullptr)
+    : _entry(__entry) {}
+
+    constexpr reference operator* () const {
+        return reference(_entry->key, _entry->value);
+    }
+
+    constexpr pointer operator-> () const {
+        return &_entry->value;
+    }
+
+    constexpr BasicMapEntryIterator& operator++ () {
+        ++_entry;
+        return *this;
+    }
+    constexpr BasicMapEntryIterator operator++ (int) {
+        BasicMapEntryIterator a(_entry);
+        operator++();
+        return a;
+    }
+
+    constexpr BasicMapEntryIterator& operator-- () {
+        --_entry;
+        return *this;
+    }
+    constexpr BasicMapEntryIterator operator-- (int) {
+        BasicMapEntryIterator a(_entry);
+        operator--();
+        return a;
+    }
+
+    constexpr bool operator== (const BasicMapEntryIterator& a) const { return _entry == a._entry; }
+    constexpr bool operator!= (const BasicMapEntryIterator& a) const { return _entry != a._entry; }
+    constexpr bool operator<  (const BasicMapEntryIterator& a) const { return _entry <  a._entry; }
+    constexpr bool operator>  (const BasicMapEntryIterator& a) const { return _entry >  a._entry; }
+    constexpr bool operator<= (const BasicMapEntryIterator& a) const { return _entry <= a._entry; }
+    constexpr bool operator>= (const BasicMapEntryIterator& a) const { return _entry >= a._entry; }
+
+private:
+
+    _Entry* _entry;
+
+};
+
+
+// both chunks rebind to the same chunk of U, so neither is ignored when U replaces them
+template <class _KeyChunk, class _ValChunk, class U>
+concept SameChunkKindC = RebindableChunkC<_KeyChunk, U> && RebindableChunkC<_ValChunk, U>
+    && std::same_as<rebind_chunk_t<_KeyChunk, U>, rebind_chunk_t<_ValChunk, U>>;
+
+
+// converts to the result of fn, so emplacing it constructs that result in place,
+// and fn is only ever called if the emplace actually constructs something
+template <class _Fn>
+struct LazyConstruct {
+    _Fn& fn;
+    constexpr operator std::invoke_result_t<_Fn&> () const { return fn(); }
+};
+
+
 
 template <
     ArrayChunk _KeyChunk,
     ArrayChunk _ValChunk,
     ArrayChunkTypeC<index_t> _IndexChunk,
-    HasherC<typename _KeyChunk::value_type> _Hasher = BasicHasher<typename _KeyChunk::value_type>,
-    CompareC<typename _KeyChunk::value_type, typename _KeyChunk::value_type> _Equal = BasicCmp<typename _KeyChunk::value_type>>
+    HasherC<typename _KeyChunk::value_type> _Hasher = DefaultHasher<typename _KeyChunk::value_type>,
+    CompareC<typename _KeyChunk::value_type, typename _KeyChunk::value_type> _Equal = BasicCmp<typename _KeyChunk::value_type>,
+    BucketVectorC _Buckets = BasicBucketVector<_IndexChunk>,
+    MapLayout _Layout = MapLayout::separate>
 class BasicMap {
 public:
 
@@ -90,113 +230,283 @@ public:
     using hasher = _Hasher;
     using key_equal = _Equal;
 
-    using iterator = MapIterator<key_type, value_type>;
-    using const_iterator = MapIterator<key_type, const value_type>;
+    static constexpr MapLayout layout = _Layout;
+    static constexpr bool interleaved = _Layout == MapLayout::interleaved;
+
+    // entries live in the kind of chunk both the keys and the values were given, see rebind_chunk
+    using entry_type = MapEntry<key_type, value_type>;
+
+    static_assert(!interleaved || SameChunkKindC<_KeyChunk, _ValChunk, entry_type>,
+        "the interleaved layout needs key and value chunks of one kind, sizes and allocator, known to rebind_chunk");
+
+    using entry_chunk_type = typename std::conditional_t<interleaved,
+        rebind_chunk<_KeyChunk, entry_type>,
+        std::type_identity<_KeyChunk>>::type;
+
+    // with the interleaved layout, the set holds whole entries
+    using set_type = std::conditional_t<interleaved,
+        BasicSet<entry_chunk_type, _IndexChunk, EntryHasher<_Hasher>, EntryEqual<_Equal>, _Buckets>,
+        BasicSet<_KeyChunk, _IndexChunk, _Hasher, _Equal, _Buckets>>;
+
+    using iterator = std::conditional_t<interleaved,
+        RemoveChainValueIterator<BasicMapEntryIterator<entry_type>>,
+        MapIterator<key_type, value_type>>;
+    using const_iterator = std::conditional_t<interleaved,
+        RemoveChainValueIterator<BasicMapEntryIterator<const entry_type>>,
+        MapIterator<const key_type, const value_type>>;
+
+    // see BasicSet::hash_of
+    template <class _T>
+    size_t hash_of (const _T& key, const _Hasher& hash = {}) const {
+        return _keys.hash_of(key, hash);
+    }
 
     template <class... _Args>
     std::pair<index_type, bool> emplace_ex (const _Hasher& hash, const _Equal& cmp, const key_type& key, _Args&&... args) {
-        std::pair<size_type, bool> result = _keys.insert(key, hash, cmp);
-        if (!result.second) return result;
-        index_type index = _vals.emplace_back(std::forward<_Args>(args)...);
-        return std::make_pair(index, true);
+        return emplace_hashed_ex(hash, cmp, hash.hash(key), key, std::forward<_Args>(args)...);
     }
     template <class... _Args>
     std::pair<index_type, bool> emplace (const key_type& key, _Args&&... args) {
         return emplace_ex({}, {}, key, std::forward<_Args>(args)...);
     }
 
+    // key_hash must be hash_of(key)
+    template <class... _Args>
+    std::pair<index_type, bool> emplace_hashed_ex (const _Hasher& hash, const _Equal& cmp, size_t key_hash, const key_type& key, _Args&&... args) {
+        if constexpr (interleaved) {
+            std::pair<size_type, bool> result = _keys.emplace_hashed(key, key_hash, hash, cmp, key, std::forward<_Args>(args)...);
+            return result;
+        } else {
+            std::pair<size_type, bool> result = _keys.insert_hashed(key, key_hash, hash, cmp);
+            if (!result.second) return result;
+            index_type index = _vals.emplace_back(std::forward<_Args>(args)...);
+            return std::make_pair(index, true);
+        }
+    }
+    template <class... _Args>
+    std::pair<index_type, bool> emplace_hashed (size_t key_hash, const key_type& key, _Args&&... args) {
+        return emplace_hashed_ex({}, {}, key_hash, key, std::forward<_Args>(args)...);
+    }
+
     std::pair<index_type, bool> insert (const key_type& key, const value_type& val, const _Hasher& hash = {}, const _Equal& cmp = {}) {
         return emplace_ex(hash, cmp, key, val);
     }
 
+    // the same as emplace, args are left untouched if the key already exists
+    template <class... _Args>
+    std::pair<index_type, bool> try_emplace (const key_type& key, _Args&&... args) {
+        return emplace_ex({}, {}, key, std::forward<_Args>(args)...);
+    }
+
+    // inserts val, or assigns it to the existing value, in a single lookup
+    template <class _V>
+    std::pair<index_type, bool> insert_or_assign (const key_type& key, _V&& val, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        std::pair<index_type, bool> result = emplace_ex(hash, cmp, key, std::forward<_V>(val));
+        if (!result.second) {
+            _val(result.first) = std::forward<_V>(val);
+        }
+        return result;
+    }
+
+    // returns the value of key, constructing it in place from factory() only if the key is new
+    template <class _Factory>
+    value_type& find_or_emplace_with (const key_type& key, _Factory&& factory, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        return _val(emplace_ex(hash, cmp, key, LazyConstruct<_Factory>{ factory }).first);
+    }
+    std::pair<index_type, bool> insert_hashed (const key_type& key, size_t key_hash, const value_type& val, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        return emplace_hashed_ex(hash, cmp, key_hash, key, val);
+    }
+
     template <class _T>
     value_type* find (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) {
         size_type index = _keys.find_index(key, hash, cmp);
-        return index == nullindex ? nullptr : &_vals[index];
+        return index == nullindex ? nullptr : &_val(index);
     }
     template <class _T>
     const value_type* find (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
         size_type index = _keys.find_index(key, hash, cmp);
-        return index == nullindex ? nullptr : &_vals[index];
+        return index == nullindex ? nullptr : &_val(index);
+    }
+
+    template <class _T>
+    value_type* find_hashed (const _T& key, size_t key_hash, const _Equal& cmp = {}) {
+        size_type index = _keys.find_index_hashed(key, key_hash, cmp);
+        return index == nullindex ? nullptr : &_val(index);
+    }
+    template <class _T>
+    const value_type* find_hashed (const _T& key, size_t key_hash, const _Equal& cmp = {}) const {
+        size_type index = _keys.find_index_hashed(key, key_hash, cmp);
+        return index == nullindex ? nullptr : &_val(index);
+    }
+
+    // finds a batch of keys at once, writing nullptr for those that do not exist.
+    // see BasicSet::find_index_batch
+    template <class _T>
+    void find_batch (Span<const _T> keys, Span<value_type*> out, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        assert(out.size() >= keys.size());
+        using key_index_type = typename set_type::index_type;
+        constexpr size_type group_size = 64;
+        key_index_type indexes[group_size];
+        for (size_type first = 0; first < keys.size(); first += group_size) {
+            size_type count = std::min(group_size, keys.size() - first);
+            _keys.find_index_batch(Span<const _T>(keys.data() + first, count), Span<key_index_type>(indexes, count), hash, cmp);
+            for (size_type i = 0; i < count; i++) {
+                value_type* val = indexes[i] == nullindex ? nullptr : &_val(indexes[i]);
+                if (val) {
+                    prefetch(val);
+                }
+                out.data()[first + i] = val;
+            }
+        }
+    }
+
+    template <class _T>
+    void contains_batch (Span<const _T> keys, Span<bool> out, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
+        _keys.contains_batch(keys, out, hash, cmp);
     }
 
     template <class _T>
     value_type& at (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) {
         size_type index = _keys.find_index(key, hash, cmp);
         assert(index != nullindex);
-        return _vals[index];
+        return _val(index);
     }
     template <class _T>
     const value_type& at (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
         size_type index = _keys.find_index(key, hash, cmp);
         assert(index != nullindex);
-        return _vals[index];
+        return _val(index);
     }
 
     value_type& operator[] (const key_type& key) {
-        return _vals[emplace(key).first];
+        return _val(emplace(key).first);
     }
     const value_type& operator[] (const key_type& key) const {
         return at(key);
     }
 
     value_type& at_index (index_type index) {
-        return _vals[index];
+        return _val(index);
     }
     const value_type& at_index (index_type index) const {
-        return _vals[index];
+        return _val(index);
     }
 
     template <class _T>
     index_type remove (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) {
-        size_type removed_index = _keys.remove(key, hash, cmp);
-        if (removed_index != nullindex) {
-            _vals.remove(removed_index);
+        return remove_hashed(key, hash.hash(key), hash, cmp);
+    }
+    template <class _T>
+    index_type remove_hashed (const _T& key, size_t key_hash, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        size_type removed_index = _keys.remove_hashed(key, key_hash, hash, cmp);
+        if constexpr (!interleaved) {
+            if (removed_index != nullindex) {
+                _vals.remove(removed_index);
+            }
         }
         return removed_index;
     }
 
+    size_type size () const { return _keys.size(); }
+
+    // closes the holes left by removed keys, calling fn(old_index, new_index)
+    // for every element. see BasicSet::compact
+    template <class _Fn>
+    void compact (_Fn&& fn) {
+        _keys.compact([&](typename set_type::index_type old_index, typename set_type::index_type new_index) {
+            fn((index_type)old_index, (index_type)new_index);
+        });
+        if constexpr (!interleaved) {
+            _vals.compact();
+        }
+    }
+
+    void compact () {
+        compact([](index_type, index_type) {});
+    }
+
+    // the set of keys, or of whole entries with the interleaved layout, sharing its indexes with the values
+    const set_type& keys () const { return _keys; }
+
+    const key_type& key_at (index_type index) const {
+        return entry_key(_keys.at((index_t)index));
+    }
+
     iterator begin () {
-        return iterator(
-            BasicMapIterator<key_type, value_type>(_keys.data(), _vals.data()),
-            _vals.remove_chain_data(),
-            _vals.remove_chain_data_end()
-        );
+        if constexpr (interleaved) {
+            return iterator(_keys.data(), _keys.remove_chain_data(), _keys.remove_chain_data_end());
+        } else {
+            return iterator(
+                BasicMapIterator<key_type, value_type>(_keys.data(), _vals.data()),
+                _vals.remove_chain_data(),
+                _vals.remove_chain_data_end()
+            );
+        }
     }
     iterator end () {
-        return iterator(
-            BasicMapIterator<key_type, value_type>(_keys.data_end(), _vals.data_end()),
-            _vals.remove_chain_data(),
-            _vals.remove_chain_data_end()
-        );
+        if constexpr (interleaved) {
+            return iterator(_keys.data_end(), _keys.remove_chain_data_end(), _keys.remove_chain_data_end());
+        } else {
+            return iterator(
+                BasicMapIterator<key_type, value_type>(_keys.data_end(), _vals.data_end()),
+                _vals.remove_chain_data_end(),
+                _vals.remove_chain_data_end()
+            );
+        }
     }
 
     const_iterator begin () const {
-        return const_iterator(
-            BasicMapIterator<key_type, const value_type>(_keys.data(), _vals.data()),
-            _vals.remove_chain_data(),
-            _vals.remove_chain_data_end()
-        );
+        if constexpr (interleaved) {
+            return const_iterator(_keys.data(), _keys.remove_chain_data(), _keys.remove_chain_data_end());
+        } else {
+            return const_iterator(
+                BasicMapIterator<const key_type, const value_type>(_keys.data(), _vals.data()),
+                _vals.remove_chain_data(),
+                _vals.remove_chain_data_end()
+            );
+        }
     }
     const_iterator end () const {
-        return const_iterator(
-            BasicMapIterator<key_type, const value_type>(_keys.data_end(), _vals.data_end()),
-            _vals.remove_chain_data(),
-            _vals.remove_chain_data_end()
-        );
+        if constexpr (interleaved) {
+            return const_iterator(_keys.data_end(), _keys.remove_chain_data_end(), _keys.remove_chain_data_end());
+        } else {
+            return const_iterator(
+                BasicMapIterator<const key_type, const value_type>(_keys.data_end(), _vals.data_end()),
+                _vals.remove_chain_data_end(),
+                _vals.remove_chain_data_end()
+            );
+        }
     }
 
 private:
 
-    BasicSet<_KeyChunk, _IndexChunk, _Hasher, _Equal> _keys;
-    BasicDenseVector<_ValChunk> _vals;
+    value_type& _val (index_t index) {
+        if constexpr (interleaved) {
+            return _keys.at(index).value;
+        } else {
+            return _vals[index];
+        }
+    }
+    const value_type& _val (index_t index) const {
+        if constexpr (interleaved) {
+            return _keys.at(index).value;
+        } else {
+            return _vals[index];
+        }
+    }
+
+    struct NoValues {};
+    using values_type = std::conditional_t<interleaved, NoValues, BasicDenseVector<_ValChunk>>;
+
+    set_type _keys;
+    [[no_unique_address]] values_type _vals;
 
 };
 
 template <
     class _Key,
     class _Val,
-    HasherC<_Key> _Hasher = BasicHasher<_Key>,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
     CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
 using Map = BasicMap<
     HeapArrayChunk<_Key>,
@@ -206,6 +516,75 @@ using Map = BasicMap<
     _Equal
 >;
 
+// a map mixing its hashes with FastHasher, see hash.h
+template <
+    class _Key,
+    class _Val,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using FastMap = Map<_Key, _Val, FastHasher<_Key>, _Equal>;
+
+// a map using open addressing with probed control bytes instead of bucket chains
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using ProbeMap = BasicMap<
+    HeapArrayChunk<_Key>,
+    HeapArrayChunk<_Val>,
+    HeapArrayChunk<index_t>,
+    _Hasher,
+    _Equal,
+    ProbeVector
+>;
+
+// a map keeping each value next to its key, for lookup heavy use
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using InterleavedMap = BasicMap<
+    HeapArrayChunk<_Key>,
+    HeapArrayChunk<_Val>,
+    HeapArrayChunk<index_t>,
+    _Hasher,
+    _Equal,
+    BucketVector,
+    MapLayout::interleaved
+>;
+
+// a map keeping the hash of every key, for keys that are expensive to hash or compare
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using HashedMap = BasicMap<
+    HeapArrayChunk<_Key>,
+    HeapArrayChunk<_Val>,
+    HeapArrayChunk<index_t>,
+    _Hasher,
+    _Equal,
+    HashedBucketVector
+>;
+
+// a map spreading the cost of a rehash over the inserts and removes following it.
+// its keys and values still grow by copying, see BasicBucketVector
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using IncrementalMap = BasicMap<
+    HeapArrayChunk<_Key>,
+    HeapArrayChunk<_Val>,
+    HeapArrayChunk<index_t>,
+    _Hasher,
+    _Equal,
+    IncrementalBucketVector
+>;
+
 
 } // namespace luna
 
@@ -1,7 +1,16 @@
 #pragma once
 #include <memory>
+#include <type_traits>
+#include <algorithm>
+#include <bit>
+#include <concepts>
+#include <cstring>
+#include <limits>
 #include "index.h"
 #include <cassert>
+#if defined(_MSC_VER)
+#include <xmmintrin.h>
+#endif
 
 
 /**
@@ -16,10 +25,71 @@ namespace luna {
     
 
 
+// hints that ptr is about to be read, so its cache line can be fetched in the meantime
+inline void prefetch (const void* ptr) {
+#if defined(__GNUC__) || defined(__clang__)
+    __builtin_prefetch(ptr);
+#elif defined(_MSC_VER)
+    _mm_prefetch((const char*)ptr, _MM_HINT_T0);
+#endif
+}
+
+
+/**
+ * @brief Whether moving a T to another address and ending the life of the original
+ * is the same as copying its bytes. Relocating such elements is a single memcpy or memmove
+ * instead of a move constructor and a destructor per element.
+ * It holds for every trivially copyable type, and other types opt in by specializing it,
+ * which is right for anything that owns memory through a pointer but never points into itself.
+ */
+template <class T>
+struct is_trivially_relocatable : std::bool_constant<std::is_trivially_copyable_v<T>> {};
+
+template <class T>
+inline constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+
+// moves [first, last) to result, ending the life of the originals.
+// the ranges may overlap as long as result comes first
+template <class T>
+void relocate (T* __first, T* __last, T* __result) {
+    if constexpr (is_trivially_relocatable_v<T>) {
+        if (__last > __first) {
+            std::memmove((void*)__result, (const void*)__first, size_t(__last - __first) * sizeof(T));
+        }
+    } else {
+        for (; __first != __last; ++__first, ++__result) {
+            std::construct_at(__result, std::move(*__first));
+            std::destroy_at(__first);
+        }
+    }
+}
+
+// moves [first, last) to end at result_last, ending the life of the originals.
+// the ranges may overlap as long as result_last comes after last
+template <class T>
+void relocate_backward (T* __first, T* __last, T* __result_last) {
+    if constexpr (is_trivially_relocatable_v<T>) {
+        if (__last > __first) {
+            std::memmove((void*)(__result_last - (__last - __first)), (const void*)__first, size_t(__last - __first) * sizeof(T));
+        }
+    } else {
+        while (__last != __first) {
+            --__last;
+            --__result_last;
+            std::construct_at(__result_last, std::move(*__last));
+            std::destroy_at(__last);
+        }
+    }
+}
+
+
+// move relocates, as the elements are left behind in memory about to be released
 struct UninitializedMove {
     template <class _InputIt, class _ForwardIt>
     static _ForwardIt move (_InputIt __first, _InputIt __last, _ForwardIt __result) {
-        return std::uninitialized_move(__first, __last, __result);
+        relocate(std::to_address(__first), std::to_address(__last), std::to_address(__result));
+        return __result + (__last - __first);
     }
     template <class _InputIt, class _ForwardIt>
     static _ForwardIt copy (_InputIt __first, _InputIt __last, _ForwardIt __result) {
@@ -87,7 +157,7 @@ public:
 
 private:
 
-    int8_t _bytes[sizeof(T) * _Len];
+    alignas(T) int8_t _bytes[sizeof(T) * _Len];
 
 };
 
@@ -120,16 +190,29 @@ public:
         _last = nullptr;
     }
 
+    // allocators with try_extend, like ArenaAllocator, get a chance to grow in place first
     template <MoveC<T*, T*> _Move>
     void reserve_move (size_type prev_count, size_type count, const _Move& mv = UninitializedMove{}) {
         if (count <= size()) return;
-        T* new_first = alloc_traits::allocate(_alloc, count);
-        if (_first) {
-            mv.move(_first, _first + prev_count, new_first);
-            alloc_traits::deallocate(_alloc, _first, size());
+        if constexpr (requires { _alloc.try_extend(_first, size(), count); }) {
+            if (_first && _alloc.try_extend(_first, size(), count)) {
+                _last = _first + count;
+                return;
+            }
         }
-        _first = new_first;
-        _last = _first + count;
+        _reallocate_move(prev_count, count, mv);
+    }
+
+    // moves the first prev_count elements into an allocation of exactly count,
+    // releasing the memory past them
+    template <MoveC<T*, T*> _Move>
+    void shrink_move (size_type prev_count, size_type count, const _Move& mv = UninitializedMove{}) {
+        if (count >= size()) return;
+        if (count == 0) {
+            deallocate();
+            return;
+        }
+        _reallocate_move(prev_count, count, mv);
     }
 
     template <class... _Args>
@@ -170,6 +253,26 @@ public:
 
 private:
 
+    // allocators with reallocate, like ReallocAllocator, may resize trivially relocatable
+    // elements without copying them, moving the pages instead when the block is mapped
+    template <MoveC<T*, T*> _Move>
+    void _reallocate_move (size_type prev_count, size_type count, const _Move& mv) {
+        if constexpr (is_trivially_relocatable_v<T> && requires { _alloc.reallocate(_first, size(), count); }) {
+            if (_first) {
+                _first = _alloc.reallocate(_first, size(), count);
+                _last = _first + count;
+                return;
+            }
+        }
+        T* new_first = alloc_traits::allocate(_alloc, count);
+        if (_first) {
+            mv.move(_first, _first + prev_count, new_first);
+            alloc_traits::deallocate(_alloc, _first, size());
+        }
+        _first = new_first;
+        _last = _first + count;
+    }
+
     [[no_unique_address]] _Alloc _alloc;
     T* _first;
     T* _last;
@@ -279,6 +382,19 @@ public:
     void reserve_move (size_type prev_count, size_type count, const _Move& mv = UninitializedMove{}) {
         if (count <= size()) return;
         if (count <= _InlineSize) return;
+        if constexpr (requires { _alloc.try_extend(_vec, _size, count); }) {
+            if (!is_compact() && _alloc.try_extend(_vec, _size, count)) {
+                _size = count;
+                return;
+            }
+        }
+        if constexpr (is_trivially_relocatable_v<T> && requires { _alloc.reallocate(_vec, _size, count); }) {
+            if (!is_compact()) {
+                _vec = _alloc.reallocate(_vec, _size, count);
+                _size = count;
+                return;
+            }
+        }
         T* new_first = alloc_traits::allocate(_alloc, count);
         mv.move(begin(), begin() + prev_count, new_first);
         if (!is_compact()) {
@@ -343,6 +459,80 @@ private:
 
 
 
+// decides the capacity a full container grows to, from its capacity and the size of its elements.
+// the result must be larger than the capacity
+template <class _Growth>
+concept GrowthPolicyC = requires (index_t capacity, size_t elt_size) {
+    { _Growth::grow(capacity, elt_size) } -> std::convertible_to<index_t>;
+};
+
+namespace growth_detail {
+
+inline index_t to_capacity (size_t count) {
+    return (index_t)std::min<size_t>(count, std::numeric_limits<index_t>::max());
+}
+
+// the fewest elements filling bytes rounded up to a multiple of unit
+inline index_t round_bytes (index_t capacity, size_t elt_size, size_t unit) {
+    size_t bytes = ((size_t)capacity * elt_size + unit - 1) / unit * unit;
+    return std::max(capacity, to_capacity(bytes / elt_size));
+}
+
+} // namespace growth_detail
+
+// multiplies the capacity by _Num / _Den, starting at _MinBytes worth of elements.
+// the default doubles from a single element
+template <size_t _Num = 2, size_t _Den = 1, size_t _MinBytes = 0>
+struct GeometricGrowth {
+    static_assert(_Num > _Den);
+
+    static index_t grow (index_t capacity, size_t elt_size) {
+        size_t count = (size_t)capacity * _Num / _Den;
+        count = std::max({ count, (size_t)capacity + 1, _MinBytes / elt_size });
+        return growth_detail::to_capacity(count);
+    }
+};
+
+using DefaultGrowth = GeometricGrowth<>;
+
+// rounds what _Inner grows to up to whole pages, so the tail of the last page is used
+// instead of wasted. meant for vectors big enough to be mapped, see HugePageAllocator
+template <class _Inner = DefaultGrowth, size_t _PageSize = 4096>
+struct PageGrowth {
+    static index_t grow (index_t capacity, size_t elt_size) {
+        return growth_detail::round_bytes(_Inner::grow(capacity, elt_size), elt_size, _PageSize);
+    }
+};
+
+// rounds what _Inner grows to up to the block the allocator would hand out anyway:
+// powers of two up to 512 bytes, like PoolAllocator, then four classes per doubling,
+// like the size classes of jemalloc and tcmalloc
+template <class _Inner = DefaultGrowth>
+struct SizeClassGrowth {
+    static index_t grow (index_t capacity, size_t elt_size) {
+        index_t count = _Inner::grow(capacity, elt_size);
+        size_t bytes = (size_t)count * elt_size;
+        if (bytes <= 512) {
+            return growth_detail::round_bytes(count, elt_size, std::bit_ceil(std::max<size_t>(bytes, 16)));
+        }
+        return growth_detail::round_bytes(count, elt_size, std::bit_floor(bytes - 1) / 4);
+    }
+};
+
+// grows like _Inner until _ThresholdBytes, then by _ThresholdBytes at a time,
+// so the memory reserved past the elements never exceeds _ThresholdBytes
+template <size_t _ThresholdBytes = 64 * 1024 * 1024, class _Inner = DefaultGrowth>
+struct CappedLinearGrowth {
+    static index_t grow (index_t capacity, size_t elt_size) {
+        size_t step = std::max<size_t>(_ThresholdBytes / elt_size, 1);
+        if ((size_t)capacity < step) {
+            return std::min(_Inner::grow(capacity, elt_size), growth_detail::to_capacity(step));
+        }
+        return growth_detail::to_capacity((size_t)capacity + step);
+    }
+};
+
+
 template <ArrayChunk _Chunk>
 class PushArrayChunk {
 public:
@@ -353,9 +543,14 @@ public:
     using allocator = typename chunk_type::allocator;
     using index_type = Index<value_type>;
 
+    // chunks that keep their elements across runs, like MmapArrayChunk, resume with them
     PushArrayChunk ()
     : _pool()
-    , _size(0) {}
+    , _size(0) {
+        if constexpr (requires { _pool.stored_size(); }) {
+            _size = _pool.stored_size();
+        }
+    }
 
     void allocate (size_type count) {
         _pool.allocate(count);
@@ -366,6 +561,7 @@ public:
     void clear () {
         _pool.clear();
         _size = 0;
+        _store_size();
     }
 
     template <MoveC<value_type*, value_type*> _Move = UninitializedMove>
@@ -374,6 +570,15 @@ public:
         _pool.reserve_move(length, count, mv);
     }
 
+    // releases the capacity past the elements, for chunks that can.
+    // inline chunks keep their memory
+    template <MoveC<value_type*, value_type*> _Move = UninitializedMove>
+    void shrink_move (const _Move& mv = UninitializedMove{}) {
+        if constexpr (requires { _pool.shrink_move(_size, _size, mv); }) {
+            _pool.shrink_move(_size, _size, mv);
+        }
+    }
+
     template <class... _Args>
     void construct (Index<value_type> index, _Args&&... args) {
         _pool.construct(index, std::forward<_Args>(args)...);
@@ -395,12 +600,14 @@ public:
         value_type* prev_end = end();
         _size += count;
         ASSERT_IN_RANGE(_size, 0, _pool.size());
+        _store_size();
         return prev_end;
     }
     // returns pointer to the prev element, does not call destructor
     value_type* pop_back (size_type count = 1) {
         _size -= count;
         ASSERT_IN_RANGE(_size, 0, _pool.size());
+        _store_size();
         return end();
     }
 
@@ -435,10 +642,12 @@ public:
 
     void set_full () {
         _size = _pool.size();
+        _store_size();
     }
 
     void set_size (size_type __size) {
         _size = __size;
+        _store_size();
     }
 
     // void set_end (T* __end) {
@@ -448,12 +657,60 @@ public:
 
 private:
 
+    void _store_size () {
+        if constexpr (requires { _pool.store_size(_size); }) {
+            _pool.store_size(_size);
+        }
+    }
+
     chunk_type _pool;
     size_type _size;
 
 };
 
 
+// a chunk holding its elements through a pointer moves with them, one holding them inline
+// is as relocatable as they are. allocators are assumed to never point into themselves
+template <class T, class _Alloc>
+struct is_trivially_relocatable<HeapArrayChunk<T, _Alloc>> : std::true_type {};
+
+template <class T, index_t _Len, class _Alloc>
+struct is_trivially_relocatable<InplaceArrayChunk<T, _Len, _Alloc>> : is_trivially_relocatable<T> {};
+
+template <class T, index_t _InlineSize, class _Alloc>
+struct is_trivially_relocatable<CompactArrayChunk<T, _InlineSize, _Alloc>> : is_trivially_relocatable<T> {};
+
+template <ArrayChunk _Chunk>
+struct is_trivially_relocatable<PushArrayChunk<_Chunk>> : is_trivially_relocatable<_Chunk> {};
+
+
+// the same kind of chunk as _Chunk, with its sizes and allocator, holding U instead.
+// has no type for chunks that do not know how to hold something else
+template <class _Chunk, class U>
+struct rebind_chunk {};
+
+template <class T, class _Alloc, class U>
+struct rebind_chunk<HeapArrayChunk<T, _Alloc>, U> {
+    using type = HeapArrayChunk<U, typename std::allocator_traits<_Alloc>::template rebind_alloc<U>>;
+};
+
+template <class T, index_t _Len, class _Alloc, class U>
+struct rebind_chunk<InplaceArrayChunk<T, _Len, _Alloc>, U> {
+    using type = InplaceArrayChunk<U, _Len, typename std::allocator_traits<_Alloc>::template rebind_alloc<U>>;
+};
+
+template <class T, index_t _InlineSize, class _Alloc, class U>
+struct rebind_chunk<CompactArrayChunk<T, _InlineSize, _Alloc>, U> {
+    using type = CompactArrayChunk<U, _InlineSize, typename std::allocator_traits<_Alloc>::template rebind_alloc<U>>;
+};
+
+template <class _Chunk, class U>
+using rebind_chunk_t = typename rebind_chunk<_Chunk, U>::type;
+
+template <class _Chunk, class U>
+concept RebindableChunkC = requires { typename rebind_chunk<_Chunk, U>::type; };
+
+
 
 } // namespace luna
 
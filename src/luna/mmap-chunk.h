@@ -0,0 +1,317 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "page-memory.h"
+#include "vector.h"
+#include "dense-vector.h"
+#include "sparse-vector.h"
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <cassert>
+#ifdef LUNA_MMAP
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+namespace luna {
+
+
+
+#ifdef LUNA_MMAP
+
+/**
+ * @brief Names the files of every MmapArrayChunk default constructed on this thread while it lives.
+ * Chunks take path.0, path.1, ... in the order they are constructed, which is the order
+ * of the members of their container, so building the same container type in the same
+ * scope again finds the same files.
+ */
+class MmapScope {
+public:
+
+    explicit MmapScope (std::string __path)
+    : _path(std::move(__path)), _prev(_current()) {
+        _current() = this;
+    }
+
+    ~MmapScope () {
+        _current() = _prev;
+    }
+
+    MmapScope (const MmapScope&) = delete;
+    MmapScope& operator= (const MmapScope&) = delete;
+
+    // the innermost scope of this thread, nullptr if there is none
+    static MmapScope* current () { return _current(); }
+
+    std::string next_path () {
+        return _path + "." + std::to_string(_next++);
+    }
+
+private:
+
+    static MmapScope*& _current () {
+        thread_local MmapScope* scope = nullptr;
+        return scope;
+    }
+
+    std::string _path;
+    MmapScope* _prev;
+    index_t _next = 0;
+
+};
+
+
+/**
+ * @brief A chunk whose elements live in a shared file mapping, so a container built on it
+ * is its own file: reopening the file maps the elements back as they were, without reading
+ * or deserializing them, and the page cache loads them lazily as they are touched.
+ * A chunk default constructed inside an MmapScope opens or creates its file there.
+ * Outside of any scope it maps anonymous memory and nothing is kept.
+ * The file starts with a header holding the capacity and the count of elements, which
+ * PushArrayChunk keeps up to date, so BasicVector resumes with the same size.
+ * Growing extends the file with ftruncate and remaps it, moving no element.
+ * Elements must be trivially copyable, as their bytes are all that is kept. BasicDenseVector
+ * keeps its remove chain in one more file, and BasicSparseVector its index chunks in two more.
+ * Writes reach the file through the page cache, msync is left to the OS.
+ * A file that cannot be opened or mapped, or that holds something else, throws
+ * std::bad_alloc like any failed growth.
+ */
+template <class T>
+class MmapArrayChunk {
+public:
+
+    static_assert(std::is_trivially_copyable_v<T>);
+
+    using value_type = T;
+    using index_type = Index<T>;
+    using size_type = index_t;
+    // nominal, elements are constructed in place
+    using allocator = std::allocator<T>;
+
+    // keeps data aligned for any T up to a cache line
+    static constexpr size_t header_size = 64;
+    static_assert(alignof(T) <= header_size);
+
+    MmapArrayChunk () {
+        MmapScope* scope = MmapScope::current();
+        if (scope) {
+            _open(scope->next_path());
+        }
+    }
+
+    // opens or creates the file at path, whatever the current scope
+    explicit MmapArrayChunk (const std::string& path) {
+        _open(path);
+    }
+
+    // resizes the file to count elements, keeping the ones that fit
+    void allocate (size_type count) {
+        _resize(count);
+        store_size(0);
+    }
+
+    // unmaps the elements and closes the file, which keeps them
+    void deallocate () {
+        if (_header) {
+            munmap(_header, _mapped_size(size()));
+        }
+        if (_fd >= 0) {
+            close(_fd);
+        }
+        _header = nullptr;
+        _first = nullptr;
+        _last = nullptr;
+        _fd = -1;
+    }
+
+    // the file keeps the elements, so remapping it never moves any
+    template <MoveC<T*, T*> _Move>
+    void reserve_move (size_type, size_type count, const _Move& = UninitializedMove{}) {
+        if (count <= size()) return;
+        _resize(count);
+    }
+
+    template <MoveC<T*, T*> _Move>
+    void shrink_move (size_type, size_type count, const _Move& = UninitializedMove{}) {
+        if (count >= size()) return;
+        _resize(count);
+    }
+
+    template <class... _Args>
+    void construct (Index<T> index, _Args&&... args) {
+        ASSERT_IN_RANGE((int)index, 0, size() - 1);
+        new(&_first[index]) T(std::forward<_Args>(args)...);
+    }
+    void destroy (Index<T> index) {
+        ASSERT_IN_RANGE((int)index, 0, size() - 1);
+    }
+
+    template <class... _Args>
+    void construct (T* ptr, _Args&&... args) {
+        new(ptr) T(std::forward<_Args>(args)...);
+    }
+    void destroy (T*) {}
+
+    size_type size () const { return _last - _first; }
+
+    T* begin () const { return _first; }
+    T* end () const { return _last; }
+    T* data () const { return _first; }
+
+    T& at (Index<T> index) {
+        ASSERT_IN_RANGE((int)index, 0, size() - 1);
+        return _first[index];
+    }
+    const T& at (Index<T> index) const {
+        ASSERT_IN_RANGE((int)index, 0, size() - 1);
+        return _first[index];
+    }
+
+    // does nothing
+    void clear () {}
+
+    // the count of elements kept in the header, see PushArrayChunk
+    size_type stored_size () const { return _header ? (size_type)_header->count : 0; }
+    void store_size (size_type count) {
+        if (_header) {
+            _header->count = count;
+        }
+    }
+
+    bool is_file () const { return _fd >= 0; }
+
+private:
+
+    struct Header {
+        uint64_t magic;
+        uint64_t elt_size;
+        uint64_t capacity;
+        uint64_t count;
+    };
+
+    static constexpr uint64_t _magic = 0x6b6e6863616e756c;
+
+    static size_t _mapped_size (size_type count) {
+        return header_size + (size_t)count * sizeof(T);
+    }
+
+    // maps an existing file whose header matches T, or starts an empty one.
+    // throws when the file cannot be opened or holds something else, rather than
+    // leaving it behind for anonymous memory
+    void _open (const std::string& path) {
+        _fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if (_fd < 0) {
+            throw std::bad_alloc();
+        }
+        struct stat st;
+        if (fstat(_fd, &st) != 0) {
+            _close_and_throw();
+        }
+        if ((size_t)st.st_size < header_size) return;
+
+        Header header;
+        if (pread(_fd, &header, sizeof(Header), 0) != sizeof(Header)
+            || header.magic != _magic || header.elt_size != sizeof(T)
+            || (size_t)st.st_size < _mapped_size((size_type)header.capacity)) {
+            _close_and_throw();
+        }
+        void* ptr = mmap(nullptr, _mapped_size((size_type)header.capacity), PROT_READ | PROT_WRITE, MAP_SHARED, _fd, 0);
+        if (ptr == MAP_FAILED) {
+            _close_and_throw();
+        }
+        _set_mapping(ptr, (size_type)header.capacity);
+    }
+
+    [[noreturn]] void _close_and_throw () {
+        close(_fd);
+        _fd = -1;
+        throw std::bad_alloc();
+    }
+
+    void _map (size_type count) {
+        int flags = _fd >= 0 ? MAP_SHARED : MAP_PRIVATE | MAP_ANONYMOUS;
+        void* ptr = mmap(nullptr, _mapped_size(count), PROT_READ | PROT_WRITE, flags, _fd, 0);
+        if (ptr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        _set_mapping(ptr, count);
+    }
+
+    void _set_mapping (void* ptr, size_type count) {
+        _header = (Header*)ptr;
+        _first = (T*)((std::byte*)ptr + header_size);
+        _last = _first + count;
+    }
+
+    void _resize (size_type count) {
+        if (_fd >= 0 && ftruncate(_fd, _mapped_size(count)) != 0) {
+            throw std::bad_alloc();
+        }
+        if (!_header) {
+            _map(count);
+            *_header = Header{ _magic, sizeof(T), 0, 0 };
+        } else {
+#ifdef LUNA_MREMAP
+            void* ptr = mremap(_header, _mapped_size(size()), _mapped_size(count), MREMAP_MAYMOVE);
+            if (ptr == MAP_FAILED) {
+                throw std::bad_alloc();
+            }
+            _set_mapping(ptr, count);
+#else
+            Header* old = _header;
+            size_type old_count = size();
+            _map(count);
+            // a file mapping already sees the elements, anonymous memory must be copied over
+            if (_fd < 0) {
+                std::memcpy(_header, old, _mapped_size(std::min(old_count, count)));
+            }
+            munmap(old, _mapped_size(old_count));
+#endif
+        }
+        _header->capacity = count;
+    }
+
+    Header* _header = nullptr;
+    T* _first = nullptr;
+    T* _last = nullptr;
+    int _fd = -1;
+
+};
+
+
+template <class T>
+struct is_trivially_relocatable<MmapArrayChunk<T>> : std::true_type {};
+
+template <class T, class U>
+struct rebind_chunk<MmapArrayChunk<T>, U> {
+    using type = MmapArrayChunk<U>;
+};
+
+template <class T>
+struct remove_chain_chunk<MmapArrayChunk<T>> {
+    using type = MmapArrayChunk<index_t>;
+};
+
+
+// containers living in files, see MmapArrayChunk
+template <class T>
+using MmapVector = BasicVector<MmapArrayChunk<T>>;
+
+template <class T>
+using MmapDenseVector = BasicDenseVector<MmapArrayChunk<T>>;
+
+template <class T>
+using MmapSparseVector = BasicSparseVector<MmapArrayChunk<T>, MmapArrayChunk<index_t>>;
+
+#endif
+
+
+
+} // namespace luna
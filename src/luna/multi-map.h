@@ -0,0 +1,197 @@
+#pragma once
+#include "map.h"
+#include "multi-set.h"
+#include <ranges>
+
+
+namespace luna {
+
+
+
+/**
+ * @brief A hash map from each key to any number of values.
+ * Keys live in a BasicMultiSet and values in a dense vector sharing its indexes,
+ * like the separate layout of BasicMap, so every value of a key is found by
+ * walking the run of that key in its bucket chain, without a Vector per key.
+ */
+template <
+    ArrayChunk _KeyChunk,
+    ArrayChunk _ValChunk,
+    ArrayChunkTypeC<index_t> _IndexChunk,
+    HasherC<typename _KeyChunk::value_type> _Hasher = DefaultHasher<typename _KeyChunk::value_type>,
+    CompareC<typename _KeyChunk::value_type, typename _KeyChunk::value_type> _Equal = BasicCmp<typename _KeyChunk::value_type>,
+    MultiBucketVectorC _Buckets = BasicBucketVector<_IndexChunk>>
+class BasicMultiMap {
+public:
+
+    using key_type = typename _KeyChunk::value_type;
+    using value_type = typename _ValChunk::value_type;
+
+    using size_type = index_t;
+    using index_type = Index<value_type>;
+
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+
+    using set_type = BasicMultiSet<_KeyChunk, _IndexChunk, _Hasher, _Equal, _Buckets>;
+
+    using iterator = MapIterator<key_type, value_type>;
+    using const_iterator = MapIterator<const key_type, const value_type>;
+
+    // see BasicSet::hash_of
+    template <class _T>
+    size_t hash_of (const _T& key, const _Hasher& hash = {}) const {
+        return _keys.hash_of(key, hash);
+    }
+
+    // always adds a value, returning its index
+    template <class... _Args>
+    index_type emplace_hashed_ex (const _Hasher& hash, const _Equal& cmp, size_t key_hash, const key_type& key, _Args&&... args) {
+        index_type index = (index_t)_keys.insert_hashed(key, key_hash, hash, cmp);
+        index_type val_index = _vals.emplace_back(std::forward<_Args>(args)...);
+        // both dense vectors reuse removed slots in the same order
+        assert(index == val_index);
+        return index;
+    }
+    template <class... _Args>
+    index_type emplace_ex (const _Hasher& hash, const _Equal& cmp, const key_type& key, _Args&&... args) {
+        return emplace_hashed_ex(hash, cmp, hash.hash(key), key, std::forward<_Args>(args)...);
+    }
+    template <class... _Args>
+    index_type emplace (const key_type& key, _Args&&... args) {
+        return emplace_ex({}, {}, key, std::forward<_Args>(args)...);
+    }
+
+    index_type insert (const key_type& key, const value_type& val, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        return emplace_ex(hash, cmp, key, val);
+    }
+    index_type insert_hashed (const key_type& key, size_t key_hash, const value_type& val, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        return emplace_hashed_ex(hash, cmp, key_hash, key, val);
+    }
+
+    // the indexes of every value of key, see BasicMultiSet::equal_range
+    template <class _T>
+    auto equal_range (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
+        return _keys.equal_range(key, hash, cmp) | std::views::transform([](auto index) { return (index_type)(index_t)index; });
+    }
+
+    // every value of key
+    template <class _T>
+    auto values_of (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        return _keys.equal_range(key, hash, cmp) | std::views::transform([this](auto index) -> value_type& { return _vals[index]; });
+    }
+    template <class _T>
+    auto values_of (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
+        return _keys.equal_range(key, hash, cmp) | std::views::transform([this](auto index) -> const value_type& { return _vals[index]; });
+    }
+
+    template <class _T>
+    size_type count (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
+        return _keys.count(key, hash, cmp);
+    }
+
+    template <class _T>
+    bool contains (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
+        return _keys.contains(key, hash, cmp);
+    }
+
+    // the first value of key, nullptr if it has none
+    template <class _T>
+    value_type* find (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        size_type index = _keys.find_index(key, hash, cmp);
+        return index == nullindex ? nullptr : &_vals[index];
+    }
+    template <class _T>
+    const value_type* find (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) const {
+        size_type index = _keys.find_index(key, hash, cmp);
+        return index == nullindex ? nullptr : &_vals[index];
+    }
+
+    value_type& at_index (index_type index) { return _vals[index]; }
+    const value_type& at_index (index_type index) const { return _vals[index]; }
+
+    const key_type& key_at (index_type index) const { return _keys.at((index_t)index); }
+
+    // removes every value of key, returns how many there were
+    template <class _T>
+    size_type remove (const _T& key, const _Hasher& hash = {}, const _Equal& cmp = {}) {
+        return _keys.remove_with(key, [&](auto index) { _vals.remove((index_t)index); }, hash, cmp);
+    }
+
+    // removes the single value at index
+    void remove_index (index_type index, const _Hasher& hash = {}) {
+        _keys.remove_index((index_t)index, hash);
+        _vals.remove(index);
+    }
+
+    size_type size () const { return _keys.size(); }
+
+    // see BasicMap::compact
+    template <class _Fn>
+    void compact (_Fn&& fn) {
+        _keys.compact([&](typename set_type::index_type old_index, typename set_type::index_type new_index) {
+            fn((index_type)(index_t)old_index, (index_type)(index_t)new_index);
+        });
+        _vals.compact();
+    }
+
+    void compact () {
+        compact([](index_type, index_type) {});
+    }
+
+    const set_type& keys () const { return _keys; }
+
+    iterator begin () {
+        return iterator(
+            BasicMapIterator<key_type, value_type>(_keys.data(), _vals.data()),
+            _vals.remove_chain_data(),
+            _vals.remove_chain_data_end()
+        );
+    }
+    iterator end () {
+        return iterator(
+            BasicMapIterator<key_type, value_type>(_keys.data_end(), _vals.data_end()),
+            _vals.remove_chain_data_end(),
+            _vals.remove_chain_data_end()
+        );
+    }
+
+    const_iterator begin () const {
+        return const_iterator(
+            BasicMapIterator<const key_type, const value_type>(_keys.data(), _vals.data()),
+            _vals.remove_chain_data(),
+            _vals.remove_chain_data_end()
+        );
+    }
+    const_iterator end () const {
+        return const_iterator(
+            BasicMapIterator<const key_type, const value_type>(_keys.data_end(), _vals.data_end()),
+            _vals.remove_chain_data_end(),
+            _vals.remove_chain_data_end()
+        );
+    }
+
+private:
+
+    set_type _keys;
+    BasicDenseVector<_ValChunk> _vals;
+
+};
+
+
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using MultiMap = BasicMultiMap<
+    HeapArrayChunk<_Key>,
+    HeapArrayChunk<_Val>,
+    HeapArrayChunk<index_t>,
+    _Hasher,
+    _Equal
+>;
+
+
+
+} // namespace luna
@@ -0,0 +1,347 @@
+#pragma once
+#include "set.h"
+#include <iterator>
+#include <ranges>
+#include <cassert>
+
+
+namespace luna {
+
+
+
+// bucket policies that can link an element in the middle of a chain, next to its equals
+template <class _Buckets>
+concept MultiBucketVectorC = BucketVectorC<_Buckets>
+    && requires (_Buckets buckets, typename _Buckets::elt_type elt, index_t n) {
+        buckets.bucket_link_before(elt, n);
+    };
+
+
+// walks the run of elements equal to a key, which a multiset keeps adjacent in its chain,
+// comparing each one to the first of the run so the key need not outlive the range
+template <class _Set, class _Equal>
+class EqualRangeIterator {
+public:
+
+    using bucket_elt_type = typename _Set::bucket_elt_type;
+    using value_type = typename _Set::index_type;
+    using reference = value_type;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::input_iterator_tag;
+
+    EqualRangeIterator () = default;
+
+    EqualRangeIterator (const _Set* __set, const _Equal& __key_equal, const bucket_elt_type& __elt)
+    : _set(__set), _key_equal(__key_equal), _elt(__elt), _first(__elt.index) {}
+
+    value_type operator* () const { return _elt.index; }
+
+    // the run ends at the first element that is not equal
+    EqualRangeIterator& operator++ () {
+        if (!_set->_buckets.get(_elt) || !_key_equal.cmp(_set->_elts[_elt.index], _set->_elts[_first])) {
+            _elt.index = nullindex;
+        }
+        return *this;
+    }
+    void operator++ (int) { operator++(); }
+
+    bool operator== (std::default_sentinel_t) const { return _elt.index == nullindex; }
+
+private:
+
+    const _Set* _set = nullptr;
+    [[no_unique_address]] _Equal _key_equal;
+    bucket_elt_type _elt;
+    index_t _first = nullindex;
+
+};
+
+
+/**
+ * @brief A hash set that keeps every inserted element, duplicates included.
+ * Elements equal to each other are kept next to each other in their bucket chain:
+ * a new one is linked in front of the first equal element, and rehashing relinks
+ * elements the same way. equal_range then walks that run of the chain, yielding
+ * dense indexes, and stops at the first element that differs, so a one to many
+ * index costs one dense slot per element instead of a Vector per key.
+ * The keys of a single bucket chain grow with its duplicates, which max_depth
+ * does not account for, but lookups stop at the first match all the same.
+ */
+template <
+    ArrayChunk _Chunk,
+    ArrayChunkTypeC<index_t> _IndexChunk,
+    HasherC<typename _Chunk::value_type> _Hasher = DefaultHasher<typename _Chunk::value_type>,
+    CompareC<typename _Chunk::value_type, typename _Chunk::value_type> _Equal = BasicCmp<typename _Chunk::value_type>,
+    MultiBucketVectorC _Buckets = BasicBucketVector<_IndexChunk>>
+class BasicMultiSet {
+public:
+
+    using container_type = BasicDenseVector<_Chunk>;
+    using buckets_type = _Buckets;
+    using bucket_elt_type = typename buckets_type::elt_type;
+    using value_type = typename container_type::value_type;
+    using size_type = index_t;
+    using index_type = Index<value_type>;
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+
+    using iterator = typename container_type::iterator;
+    using const_iterator = typename container_type::const_iterator;
+
+    template <class _Set, class _Eq>
+    friend class EqualRangeIterator;
+
+    BasicMultiSet (size_type __bucket_count = 101, size_type __max_depth = 4, size_type __resize_scaler = 8)
+    : _max_depth(__max_depth), _resize_scaler(__resize_scaler) {
+        _buckets.resize_buckets(__bucket_count);
+    }
+
+    // see BasicSet::hash_of
+    template <class _T>
+    size_t hash_of (const _T& val, const _Hasher& __hasher = {}) const {
+        return __hasher.hash(val);
+    }
+
+    // always inserts, returning the index of the new element
+    index_type insert (const value_type& val, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        return emplace_hashed(val, __hasher.hash(val), __hasher, __key_equal, val);
+    }
+
+    index_type insert_hashed (const value_type& val, size_t hash, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        return emplace_hashed(val, hash, __hasher, __key_equal, val);
+    }
+
+    // constructs an element from args, which must compare equal to key
+    template <class _T, class... _Args>
+    index_type emplace_hashed (const _T& key, size_t hash, const _Hasher& __hasher, const _Equal& __key_equal, _Args&&... args) {
+        _migrate(__hasher);
+        maybe_rehash(__hasher, __key_equal);
+        index_type index = _elts.emplace_back(std::forward<_Args>(args)...);
+        _link(key, hash, index, __key_equal);
+        return index;
+    }
+
+    // the indexes of every element equal to key, as an input range
+    template <class _T>
+    auto equal_range (const _T& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return equal_range_hashed(key, __hasher.hash(key), __key_equal);
+    }
+
+    template <class _T>
+    auto equal_range_hashed (const _T& key, size_t hash, const _Equal& __key_equal = {}) const {
+        using range_iterator = EqualRangeIterator<BasicMultiSet, _Equal>;
+        return std::ranges::subrange(
+            range_iterator(this, __key_equal, _find_bucket_elt(key, hash, __key_equal)),
+            std::default_sentinel);
+    }
+
+    template <class _T>
+    size_type count (const _T& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        size_type n = 0;
+        for (index_type index : equal_range(key, __hasher, __key_equal)) {
+            (void)index;
+            n++;
+        }
+        return n;
+    }
+
+    // the index of the first element equal to key, nullindex if there is none
+    template <class _T>
+    index_type find_index (const _T& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return _find_bucket_elt(key, __hasher.hash(key), __key_equal).index;
+    }
+
+    template <class _T>
+    index_type find_index_hashed (const _T& key, size_t hash, const _Equal& __key_equal = {}) const {
+        return _find_bucket_elt(key, hash, __key_equal).index;
+    }
+
+    template <class _T>
+    bool contains (const _T& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        return find_index(key, __hasher, __key_equal) != nullindex;
+    }
+
+    // removes every element equal to key, calling fn(index) for each. returns how many there were
+    template <class _T, class _Fn>
+    size_type remove_with (const _T& key, _Fn&& fn, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        _migrate(__hasher);
+        size_t hash = __hasher.hash(key);
+        size_type n = 0;
+        // the run is unlinked from its front, each lookup walking the same chain prefix to what is left of it
+        for (bucket_elt_type elt = _find_bucket_elt(key, hash, __key_equal); elt.index != nullindex;
+            elt = _find_bucket_elt(key, hash, __key_equal)) {
+            _buckets.bucket_remove(elt);
+            _elts.remove(elt.index);
+            fn((index_type)elt.index);
+            n++;
+        }
+        return n;
+    }
+
+    template <class _T>
+    size_type remove (const _T& key, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        return remove_with(key, [](index_type) {}, __hasher, __key_equal);
+    }
+
+    // removes the single element at index
+    void remove_index (index_type index, const _Hasher& __hasher = {}) {
+        assert(_elts.is_valid(index));
+        _migrate(__hasher);
+        bucket_elt_type elt = _buckets.bucket_start(_hash_at(index, __hasher));
+        while (_buckets.get(elt) && elt.index != (index_t)index) {}
+        assert(elt.index == (index_t)index);
+        _buckets.bucket_remove(elt);
+        _elts.remove(index);
+    }
+
+    // every element is linked in front of the first equal one already relinked, like an insert
+    void rehash (size_type __bucket_count, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        _buckets.resize_buckets(__bucket_count);
+        for (auto [i, val] : _elts.ipairs()) {
+            _link(val, _hash_at(i, __hasher), i, __key_equal);
+        }
+    }
+
+    // makes room for count elements, so that inserting up to count elements does not rehash
+    void reserve (size_type count, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        _elts.reserve(count);
+        size_type buckets = _buckets.bucket_count_for(count, _max_depth);
+        if (buckets > bucket_count()) {
+            rehash(buckets, __hasher, __key_equal);
+        }
+    }
+
+    // see BasicSet::compact. renumbering keeps the order of every chain, so runs stay adjacent
+    template <class _Fn>
+    void compact (_Fn&& fn) {
+        Vector<index_t> remap(_elts.full_size(), nullindex);
+        _elts.compact([&](index_type old_index, index_type new_index) {
+            remap[(index_t)old_index] = new_index;
+            fn(old_index, new_index);
+        });
+        _buckets.remap_indexes(Span<const index_t>(remap.data(), remap.size()), _elts.size());
+    }
+
+    void compact () {
+        compact([](index_type, index_type) {});
+    }
+
+    // see BasicSet::maybe_rehash
+    bool maybe_rehash (const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        if (!_buckets.needs_rehash(_elts.size(), _max_depth)) {
+            if constexpr (requires { _buckets.needs_rebuild(); }) {
+                if (_buckets.needs_rebuild()) {
+                    _buckets.reset_filter();
+                    for (auto [i, val] : _elts.ipairs()) {
+                        _buckets.filter_add(_hash_at(i, __hasher));
+                    }
+                }
+            }
+            return false;
+        }
+        // migrating moves whole chains at a time, so runs stay adjacent
+        if constexpr (_is_incremental()) {
+            while (_buckets.is_rehashing()) {
+                _migrate(__hasher);
+            }
+            _buckets.start_rehash(_buckets.rehash_count(_elts.size(), _resize_scaler));
+        } else {
+            rehash(_buckets.rehash_count(_elts.size(), _resize_scaler), __hasher, __key_equal);
+        }
+        return true;
+    }
+
+    value_type& at (index_type index) { return _elts.at(index); }
+    const value_type& at (index_type index) const { return _elts.at(index); }
+
+    iterator begin () { return _elts.begin(); }
+    iterator end () { return _elts.end(); }
+    const_iterator begin () const { return _elts.begin(); }
+    const_iterator end () const { return _elts.end(); }
+
+    size_type size () const { return _elts.size(); }
+    size_type full_size () const { return _elts.full_size(); }
+    bool is_valid (index_type index) const { return _elts.is_valid(index); }
+
+    auto ipairs () { return _elts.ipairs(); }
+    auto ipairs () const { return _elts.ipairs(); }
+
+    size_type bucket_count () const { return _buckets.bucket_count(); }
+
+    value_type* data () { return _elts.data(); }
+    value_type* data_end () { return _elts.data_end(); }
+    const value_type* data () const { return _elts.data(); }
+    const value_type* data_end () const { return _elts.data_end(); }
+
+    const size_type* remove_chain_data () const { return _elts.remove_chain_data(); }
+    const size_type* remove_chain_data_end () const { return _elts.remove_chain_data_end(); }
+
+private:
+
+    static constexpr bool _stores_hash () {
+        if constexpr (requires { buckets_type::stores_hash; }) {
+            return buckets_type::stores_hash;
+        } else {
+            return false;
+        }
+    }
+
+    static constexpr bool _is_incremental () {
+        if constexpr (requires { buckets_type::incremental; }) {
+            return buckets_type::incremental;
+        } else {
+            return false;
+        }
+    }
+
+    void _migrate (const _Hasher& __hasher) {
+        if constexpr (_is_incremental()) {
+            if (_buckets.is_rehashing()) {
+                _buckets.migrate([&](index_type index) { return __hasher.hash(_elts[index]); });
+            }
+        }
+    }
+
+    size_t _hash_at (index_type index, const _Hasher& __hasher) const {
+        if constexpr (_stores_hash()) {
+            return _buckets.stored_hash(index);
+        } else {
+            return __hasher.hash(_elts[index]);
+        }
+    }
+
+    // links index in front of the first element equal to key, or at the end of its chain
+    template <class _T>
+    void _link (const _T& key, size_t hash, index_type index, const _Equal& __key_equal) {
+        bucket_elt_type elt = _find_bucket_elt(key, hash, __key_equal);
+        _buckets.bucket_link_before(elt, index);
+    }
+
+    template <class _T>
+    bucket_elt_type _find_bucket_elt (const _T& val, size_t hash, const _Equal& __cmp) const {
+        bucket_elt_type bucket_elt = _buckets.bucket_start(hash);
+        while (_buckets.get(bucket_elt)) {
+            if (__cmp.cmp(_elts[bucket_elt.index], val)) {
+                return bucket_elt;
+            }
+        }
+        return bucket_elt;
+    }
+
+    buckets_type _buckets;
+    container_type _elts;
+
+    size_type _max_depth = 4;
+    size_type _resize_scaler = 4;
+
+};
+
+
+template <class T,
+    HasherC<T> _Hasher = DefaultHasher<T>,
+    CompareC<T, T> _Equal = BasicCmp<T>>
+using MultiSet = BasicMultiSet<HeapArrayChunk<T>, HeapArrayChunk<index_t>, _Hasher, _Equal>;
+
+
+
+} // namespace luna
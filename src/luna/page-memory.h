@@ -0,0 +1,310 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "vector.h"
+#include "map.h"
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+#include <cassert>
+#if defined(__unix__) || defined(__APPLE__)
+#include <sys/mman.h>
+#define LUNA_MMAP
+#endif
+#if defined(__linux__) && defined(MREMAP_MAYMOVE)
+#define LUNA_MREMAP
+#endif
+
+
+namespace luna {
+
+
+
+// the size of a transparent huge page on x86-64 and most arm64 kernels
+inline constexpr size_t huge_page_size = 2 * 1024 * 1024;
+
+
+/**
+ * @brief An allocator whose allocations all start on an _Align boundary,
+ * such as a cache line, so SIMD kernels can use aligned loads and elements
+ * placed a line apart are guaranteed never to share one.
+ */
+template <class T, size_t _Align = 64>
+class AlignedAllocator {
+public:
+
+    static_assert(std::has_single_bit(_Align) && _Align >= alignof(T));
+
+    using value_type = T;
+
+    static constexpr size_t alignment = _Align;
+
+    template <class U>
+    struct rebind { using other = AlignedAllocator<U, std::max(_Align, alignof(U))>; };
+
+    AlignedAllocator () = default;
+
+    template <class U, size_t _OtherAlign>
+    AlignedAllocator (const AlignedAllocator<U, _OtherAlign>&) {}
+
+    T* allocate (size_t count) {
+        return (T*)::operator new(count * sizeof(T), std::align_val_t(_Align));
+    }
+
+    void deallocate (T* ptr, size_t) {
+        ::operator delete(ptr, std::align_val_t(_Align));
+    }
+
+    template <class U, size_t _OtherAlign>
+    bool operator== (const AlignedAllocator<U, _OtherAlign>&) const { return true; }
+
+};
+
+
+// allocations of at least _Threshold bytes are mapped on huge page boundaries,
+// and with _Lock they are also locked in memory so they are never paged out
+template <size_t _Threshold = huge_page_size, bool _Lock = false>
+struct HugePagePolicy {
+    static constexpr size_t threshold = _Threshold;
+    static constexpr bool lock = _Lock;
+};
+
+// for latency critical tables, whose first touch of a page must never fault to disk
+using LockedHugePages = HugePagePolicy<huge_page_size, true>;
+
+
+/**
+ * @brief An allocator backing large allocations with transparent huge pages,
+ * so a multi GB Vector or bucket array needs one TLB entry per 2MB instead of per 4KB.
+ * Allocations of at least _Policy::threshold bytes are mapped directly, rounded up
+ * to whole huge pages and aligned on one, then advised with MADV_HUGEPAGE.
+ * Smaller ones, and every allocation where mmap is not available, go through
+ * AlignedAllocator<T, _Align>. Locking is best effort: when mlock fails, as it does
+ * past RLIMIT_MEMLOCK, the memory is still handed out, just not locked.
+ */
+template <class T, class _Policy = HugePagePolicy<>, size_t _Align = 64>
+class HugePageAllocator {
+public:
+
+    using value_type = T;
+    using policy_type = _Policy;
+
+    template <class U>
+    struct rebind { using other = HugePageAllocator<U, _Policy, std::max(_Align, alignof(U))>; };
+
+    HugePageAllocator () = default;
+
+    template <class U, size_t _OtherAlign>
+    HugePageAllocator (const HugePageAllocator<U, _Policy, _OtherAlign>&) {}
+
+    T* allocate (size_t count) {
+#ifdef LUNA_MMAP
+        size_t bytes = count * sizeof(T);
+        if (mapped(bytes)) {
+            return (T*)_map(_round(bytes));
+        }
+#endif
+        return AlignedAllocator<T, _Align>().allocate(count);
+    }
+
+    void deallocate (T* ptr, size_t count) {
+#ifdef LUNA_MMAP
+        size_t bytes = count * sizeof(T);
+        if (mapped(bytes)) {
+            munmap(ptr, _round(bytes));
+            return;
+        }
+#endif
+        AlignedAllocator<T, _Align>().deallocate(ptr, count);
+    }
+
+    // whether an allocation of bytes bypasses the heap
+    static constexpr bool mapped (size_t bytes) {
+#ifdef LUNA_MMAP
+        return bytes >= _Policy::threshold;
+#else
+        return false;
+#endif
+    }
+
+    template <class U, size_t _OtherAlign>
+    bool operator== (const HugePageAllocator<U, _Policy, _OtherAlign>&) const { return true; }
+
+private:
+
+    static constexpr size_t _round (size_t bytes) {
+        return (bytes + huge_page_size - 1) & ~(huge_page_size - 1);
+    }
+
+#ifdef LUNA_MMAP
+    // maps one huge page more than needed, then unmaps what lies outside the aligned range
+    static void* _map (size_t bytes) {
+        size_t mapped_bytes = bytes + huge_page_size;
+        void* ptr = mmap(nullptr, mapped_bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+        uintptr_t first = (uintptr_t)ptr;
+        uintptr_t aligned = (first + huge_page_size - 1) & ~(uintptr_t)(huge_page_size - 1);
+        if (aligned > first) {
+            munmap(ptr, aligned - first);
+        }
+        size_t tail = first + mapped_bytes - (aligned + bytes);
+        if (tail > 0) {
+            munmap((void*)(aligned + bytes), tail);
+        }
+#ifdef MADV_HUGEPAGE
+        madvise((void*)aligned, bytes, MADV_HUGEPAGE);
+#endif
+        if constexpr (_Policy::lock) {
+            mlock((void*)aligned, bytes);
+        }
+        return (void*)aligned;
+    }
+#endif
+
+};
+
+
+/**
+ * @brief An allocator able to resize a block of trivially copyable elements without
+ * the allocate, copy and free that would briefly need both blocks at once.
+ * Blocks smaller than _MapThreshold bytes come from malloc and are grown with realloc,
+ * which extends them in place whenever the heap has room after them. Larger blocks are
+ * mapped directly and grown with mremap, so the kernel moves page table entries
+ * instead of copying, and growing a multi GB Vector costs neither a copy nor a peak
+ * of twice its memory. Where mremap is not available, every block goes through realloc.
+ * HeapArrayChunk calls reallocate only for trivially relocatable elements.
+ */
+template <class T, size_t _MapThreshold = 1024 * 1024>
+class ReallocAllocator {
+public:
+
+    static_assert(alignof(T) <= alignof(std::max_align_t));
+
+    using value_type = T;
+
+    template <class U>
+    struct rebind { using other = ReallocAllocator<U, _MapThreshold>; };
+
+    ReallocAllocator () = default;
+
+    template <class U>
+    ReallocAllocator (const ReallocAllocator<U, _MapThreshold>&) {}
+
+    T* allocate (size_t count) {
+        return (T*)_allocate(count * sizeof(T));
+    }
+
+    void deallocate (T* ptr, size_t count) {
+        _deallocate(ptr, count * sizeof(T));
+    }
+
+    // the block keeps its first min(old_count, count) elements, wherever it ends up
+    T* reallocate (T* ptr, size_t old_count, size_t count) {
+        size_t old_bytes = old_count * sizeof(T);
+        size_t bytes = count * sizeof(T);
+        void* moved = nullptr;
+        if (!mapped(old_bytes) && !mapped(bytes)) {
+            moved = std::realloc(ptr, bytes);
+        }
+#ifdef LUNA_MREMAP
+        else if (mapped(old_bytes) && mapped(bytes)) {
+            moved = mremap(ptr, old_bytes, bytes, MREMAP_MAYMOVE);
+            moved = moved == MAP_FAILED ? nullptr : moved;
+        }
+#endif
+        else {
+            // crossing the threshold changes how the block is freed, so it must be copied once
+            moved = _allocate(bytes);
+            std::memcpy(moved, ptr, std::min(old_bytes, bytes));
+            _deallocate(ptr, old_bytes);
+        }
+        if (!moved) {
+            throw std::bad_alloc();
+        }
+        return (T*)moved;
+    }
+
+    // whether a block of bytes is mapped rather than taken from malloc
+    static constexpr bool mapped (size_t bytes) {
+#ifdef LUNA_MREMAP
+        return bytes >= _MapThreshold;
+#else
+        return false;
+#endif
+    }
+
+    template <class U>
+    bool operator== (const ReallocAllocator<U, _MapThreshold>&) const { return true; }
+
+private:
+
+    static void* _allocate (size_t bytes) {
+        void* ptr = nullptr;
+#ifdef LUNA_MREMAP
+        if (mapped(bytes)) {
+            ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            ptr = ptr == MAP_FAILED ? nullptr : ptr;
+        } else
+#endif
+        {
+            ptr = std::malloc(bytes);
+        }
+        if (!ptr) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    // the kernel rounds mapped lengths up to whole pages, just as mmap did
+    static void _deallocate (void* ptr, size_t bytes) {
+#ifdef LUNA_MREMAP
+        if (mapped(bytes)) {
+            munmap(ptr, bytes);
+            return;
+        }
+#endif
+        std::free(ptr);
+    }
+
+};
+
+
+template <class T, size_t _Align = 64>
+using AlignedHeapArrayChunk = HeapArrayChunk<T, AlignedAllocator<T, _Align>>;
+
+template <class T, class _Policy = HugePagePolicy<>>
+using HugePageHeapArrayChunk = HeapArrayChunk<T, HugePageAllocator<T, _Policy>>;
+
+template <class T, size_t _Align = 64>
+using AlignedVector = BasicVector<AlignedHeapArrayChunk<T, _Align>>;
+
+template <class T, class _Policy = HugePagePolicy<>>
+using HugePageVector = BasicVector<HugePageHeapArrayChunk<T, _Policy>>;
+
+template <class T>
+using ReallocVector = Vector<T, ReallocAllocator<T>>;
+
+// a map whose large key, value and bucket arrays are backed by huge pages, see HugePageAllocator
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>,
+    class _Policy = HugePagePolicy<>>
+using HugePageMap = BasicMap<
+    HugePageHeapArrayChunk<_Key, _Policy>,
+    HugePageHeapArrayChunk<_Val, _Policy>,
+    HugePageHeapArrayChunk<index_t, _Policy>,
+    _Hasher,
+    _Equal
+>;
+
+
+
+} // namespace luna
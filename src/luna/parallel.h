@@ -0,0 +1,52 @@
+#pragma once
+#include "index.h"
+#include "vector.h"
+#include <thread>
+#include <algorithm>
+#include <cstdint>
+
+
+namespace luna {
+
+
+
+// passed to operations that can spread their work over several threads
+struct ParallelPolicy {
+    index_t thread_count = std::max((index_t)std::thread::hardware_concurrency(), 1);
+};
+
+
+// calls fn(thread_index) on thread_count threads, thread 0 being the calling one
+template <class _Fn>
+void parallel_run (index_t thread_count, _Fn&& fn) {
+    Vector<std::thread> threads;
+    for (index_t t = 1; t < thread_count; t++) {
+        threads.emplace_back(fn, t);
+    }
+    fn(0);
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+}
+
+// the range of [0, count) thread_index gets when split over thread_count threads.
+// the same arguments always give the same range, so passes over the same data line up
+inline std::pair<index_t, index_t> parallel_range (index_t count, index_t thread_count, index_t thread_index) {
+    return std::make_pair(
+        (index_t)((int64_t)count * thread_index / thread_count),
+        (index_t)((int64_t)count * (thread_index + 1) / thread_count)
+    );
+}
+
+// splits [0, count) over thread_count threads, calling fn(thread_index, first, last)
+template <class _Fn>
+void parallel_ranges (index_t count, index_t thread_count, _Fn&& fn) {
+    parallel_run(thread_count, [&](index_t t) {
+        auto [first, last] = parallel_range(count, thread_count, t);
+        fn(t, first, last);
+    });
+}
+
+
+
+} // namespace luna
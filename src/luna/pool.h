@@ -0,0 +1,205 @@
+#pragma once
+#include "index.h"
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <cassert>
+
+
+namespace luna {
+
+
+
+enum class PoolMode {
+    // each thread allocates from and frees to its own free lists, without any locking
+    thread_local_lists,
+    // every thread shares one set of free lists behind a lock, so memory freed
+    // on one thread is reused by all the others
+    shared,
+};
+
+
+namespace pool_detail {
+
+// blocks of 16 to 512 bytes, a power of two each. 16 keeps every block aligned like max_align_t
+inline constexpr size_t min_block_size = 16;
+inline constexpr size_t max_block_size = 512;
+inline constexpr index_t class_count = std::countr_zero(max_block_size) - std::countr_zero(min_block_size) + 1;
+inline constexpr size_t slab_size = 64 * 1024;
+
+// the smallest class fitting bytes
+inline index_t class_of (size_t bytes) {
+    size_t size = std::bit_ceil(std::max(bytes, min_block_size));
+    return std::countr_zero(size) - std::countr_zero(min_block_size);
+}
+
+inline constexpr size_t class_size (index_t size_class) {
+    return min_block_size << size_class;
+}
+
+struct FreeBlock {
+    FreeBlock* next;
+};
+
+// hands out slabs, which are never returned. blocks may be freed on any thread,
+// even after the thread that carved them has exited, so slabs cannot belong to one.
+// the first min_block_size bytes of a slab link it to the previous one, keeping them all reachable
+class SlabSource {
+public:
+
+    // the usable bytes of the slab, past its link
+    static std::byte* take () {
+        FreeBlock* slab = (FreeBlock*)::operator new(slab_size);
+        slab->next = _head.load(std::memory_order_relaxed);
+        while (!_head.compare_exchange_weak(slab->next, slab, std::memory_order_release, std::memory_order_relaxed)) {}
+        _count.fetch_add(1, std::memory_order_relaxed);
+        return (std::byte*)slab + min_block_size;
+    }
+
+    static size_t count () { return _count.load(std::memory_order_relaxed); }
+
+private:
+
+    static inline std::atomic<FreeBlock*> _head = nullptr;
+    static inline std::atomic<size_t> _count = 0;
+
+};
+
+// one free list per size class, refilled a slab at a time
+class FreeLists {
+public:
+
+    void* allocate (index_t size_class) {
+        FreeBlock* block = _heads[size_class];
+        if (!block) {
+            block = _refill(size_class);
+        }
+        _heads[size_class] = block->next;
+        return block;
+    }
+
+    void deallocate (void* ptr, index_t size_class) {
+        FreeBlock* block = (FreeBlock*)ptr;
+        block->next = _heads[size_class];
+        _heads[size_class] = block;
+    }
+
+private:
+
+    // carves a slab into blocks, linked in address order so allocations start out sequential
+    FreeBlock* _refill (index_t size_class) {
+        std::byte* slab = SlabSource::take();
+        size_t size = class_size(size_class);
+        size_t count = (slab_size - min_block_size) / size;
+        for (size_t i = 0; i < count; i++) {
+            FreeBlock* block = (FreeBlock*)(slab + i * size);
+            block->next = i + 1 < count ? (FreeBlock*)(slab + (i + 1) * size) : nullptr;
+        }
+        return (FreeBlock*)slab;
+    }
+
+    FreeBlock* _heads[class_count] = {};
+
+};
+
+inline FreeLists& local_lists () {
+    thread_local FreeLists lists;
+    return lists;
+}
+
+struct SharedLists {
+    std::mutex mutex;
+    FreeLists lists;
+};
+
+inline SharedLists& shared_lists () {
+    static SharedLists lists;
+    return lists;
+}
+
+} // namespace pool_detail
+
+
+/**
+ * @brief A stateless allocator serving small allocations from size class free lists,
+ * for containers embedded by the million whose first allocations are all tiny.
+ * Every size up to 512 bytes is rounded to a power of two, and each class is refilled
+ * by carving a 64KB slab, so most allocations pop a free list instead of calling malloc.
+ * Larger or overaligned allocations go to std::allocator.
+ * Slabs are never released: freed blocks go back to a free list for reuse.
+ * With PoolMode::thread_local_lists, a block freed on another thread joins that thread's lists,
+ * and blocks left on the lists of a thread when it exits are not reused.
+ */
+template <class T, PoolMode _Mode = PoolMode::thread_local_lists>
+class PoolAllocator {
+public:
+
+    using value_type = T;
+
+    static constexpr PoolMode mode = _Mode;
+
+    template <class U>
+    struct rebind { using other = PoolAllocator<U, _Mode>; };
+
+    PoolAllocator () = default;
+
+    template <class U>
+    PoolAllocator (const PoolAllocator<U, _Mode>&) {}
+
+    T* allocate (size_t count) {
+        size_t bytes = count * sizeof(T);
+        if (!_pooled(bytes)) {
+            return std::allocator<T>().allocate(count);
+        }
+        index_t size_class = pool_detail::class_of(bytes);
+        if constexpr (_Mode == PoolMode::shared) {
+            pool_detail::SharedLists& shared = pool_detail::shared_lists();
+            std::lock_guard lock(shared.mutex);
+            return (T*)shared.lists.allocate(size_class);
+        } else {
+            return (T*)pool_detail::local_lists().allocate(size_class);
+        }
+    }
+
+    void deallocate (T* ptr, size_t count) {
+        size_t bytes = count * sizeof(T);
+        if (!_pooled(bytes)) {
+            std::allocator<T>().deallocate(ptr, count);
+            return;
+        }
+        index_t size_class = pool_detail::class_of(bytes);
+        if constexpr (_Mode == PoolMode::shared) {
+            pool_detail::SharedLists& shared = pool_detail::shared_lists();
+            std::lock_guard lock(shared.mutex);
+            shared.lists.deallocate(ptr, size_class);
+        } else {
+            pool_detail::local_lists().deallocate(ptr, size_class);
+        }
+    }
+
+    // slabs taken so far by every pool allocator, each one a single call to operator new
+    static size_t slab_count () { return pool_detail::SlabSource::count(); }
+
+    template <class U>
+    bool operator== (const PoolAllocator<U, _Mode>&) const { return true; }
+
+private:
+
+    static constexpr bool _pooled (size_t bytes) {
+        return bytes != 0 && bytes <= pool_detail::max_block_size && alignof(T) <= pool_detail::min_block_size;
+    }
+
+};
+
+
+template <class T>
+using SharedPoolAllocator = PoolAllocator<T, PoolMode::shared>;
+
+
+
+} // namespace luna
@@ -0,0 +1,260 @@
+#pragma once
+#include "index.h"
+#include "memory.h"
+#include "vector.h"
+#include <bit>
+#include <cstdint>
+#include <cassert>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LUNA_SSE2
+#endif
+
+
+namespace luna {
+
+
+// control byte states, any non negative control byte is the 7 bit tag of a full slot
+static constexpr int8_t ctrl_empty = -128;
+static constexpr int8_t ctrl_deleted = -2;
+
+
+// a view over 16 control bytes, which are all compared at once
+class ProbeGroup {
+public:
+
+    static constexpr index_t width = 16;
+
+    explicit ProbeGroup (const int8_t* __ctrl) {
+#ifdef LUNA_SSE2
+        _ctrl = _mm_loadu_si128((const __m128i*)__ctrl);
+#else
+        _ctrl = __ctrl;
+#endif
+    }
+
+    // bitmask of the slots whose tag equals tag
+    uint32_t match (int8_t tag) const {
+#ifdef LUNA_SSE2
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(tag), _ctrl));
+#else
+        uint32_t mask = 0;
+        for (index_t i = 0; i < width; i++) {
+            mask |= (uint32_t)(_ctrl[i] == tag) << i;
+        }
+        return mask;
+#endif
+    }
+
+    uint32_t match_empty () const {
+        return match(ctrl_empty);
+    }
+
+    // empty and deleted are the only states with the sign bit set
+    uint32_t match_empty_or_deleted () const {
+#ifdef LUNA_SSE2
+        return _mm_movemask_epi8(_ctrl);
+#else
+        uint32_t mask = 0;
+        for (index_t i = 0; i < width; i++) {
+            mask |= (uint32_t)(_ctrl[i] < 0) << i;
+        }
+        return mask;
+#endif
+    }
+
+private:
+
+#ifdef LUNA_SSE2
+    __m128i _ctrl;
+#else
+    const int8_t* _ctrl;
+#endif
+
+};
+
+
+struct ProbeElt {
+    using size_type = index_t;
+
+    bool at_end () const { return started && index == nullindex; }
+
+    size_type index = nullindex;
+    // slot of index, or the slot a new element is placed in once at_end
+    size_type slot = nullindex;
+    size_type insert_slot = nullindex;
+    size_type group = 0;
+    size_type step = 0;
+    uint32_t matches = 0;
+    int8_t tag = 0;
+    bool started = false;
+};
+
+
+/**
+ * @brief An open addressing alternative to BasicBucketVector.
+ * Slots are split into groups of 16, each slot having a control byte holding
+ * a 7 bit tag of the hash. A lookup compares the tags of a whole group at
+ * once, so only slots with a matching tag are ever compared against the
+ * stored elements, and a miss usually resolves from a single group.
+ * Slots hold indexes into the dense element storage of the set, so indexes
+ * stay stable across rehashes.
+ */
+template <ArrayChunkTypeC<index_t> _Chunk = HeapArrayChunk<index_t>>
+class BasicProbeVector {
+public:
+
+    using chunk_type = _Chunk;
+    using size_type = index_t;
+    using elt_type = ProbeElt;
+    using ctrl_chunk_type = HeapArrayChunk<int8_t,
+        typename std::allocator_traits<typename chunk_type::allocator>::template rebind_alloc<int8_t>>;
+
+    static constexpr size_type group_width = ProbeGroup::width;
+
+    // rounds count up to a power of two number of groups
+    void resize_buckets (size_type count) {
+        size_type groups = std::bit_ceil((unsigned)std::max((count + group_width - 1) / group_width, 1));
+        _ctrl.clear();
+        _ctrl.resize(groups * group_width, ctrl_empty);
+        _slots.clear();
+        _slots.resize(groups * group_width, nullindex);
+        _group_mask = groups - 1;
+        _used = 0;
+    }
+
+    ProbeElt bucket_start (size_t hash) const {
+        size_t h = _mix(hash);
+        return ProbeElt{
+            .group = (size_type)((h >> 7) & _group_mask),
+            .tag = (int8_t)(h & 0x7F),
+        };
+    }
+
+    // prefetches the group the next get reads, later gets mostly stay within it
+    void prefetch_bucket (const ProbeElt& elt) const {
+        if (!elt.started) {
+            prefetch(_group_ctrl(elt.group));
+            prefetch(_slots.data() + elt.group * group_width);
+        }
+    }
+
+    // advances to the next slot whose tag matches, stopping at the first group with an empty slot
+    bool get (ProbeElt& elt) const {
+        while (true) {
+            if (elt.matches) {
+                elt.slot = elt.group * group_width + std::countr_zero(elt.matches);
+                elt.matches &= elt.matches - 1;
+                elt.index = _slots[elt.slot];
+                return true;
+            }
+            if (elt.started) {
+                if (ProbeGroup(_group_ctrl(elt.group)).match_empty()) {
+                    elt.index = nullindex;
+                    elt.slot = elt.insert_slot;
+                    return false;
+                }
+                elt.step++;
+                elt.group = (elt.group + elt.step) & _group_mask;
+            }
+            elt.started = true;
+            ProbeGroup group(_group_ctrl(elt.group));
+            elt.matches = group.match(elt.tag);
+            if (elt.insert_slot == nullindex) {
+                uint32_t free = group.match_empty_or_deleted();
+                if (free) {
+                    elt.insert_slot = elt.group * group_width + std::countr_zero(free);
+                }
+            }
+        }
+    }
+
+    void bucket_append (const ProbeElt& elt, size_type index) {
+        assert(elt.at_end());
+        if (_ctrl[elt.slot] == ctrl_empty) {
+            _used++;
+        }
+        _ctrl[elt.slot] = elt.tag;
+        _slots[elt.slot] = index;
+    }
+
+    // places an element known not to be in the table into the first free slot of its probe sequence
+    void bucket_insert (size_t hash, size_type index) {
+        ProbeElt elt = bucket_start(hash);
+        while (true) {
+            uint32_t free = ProbeGroup(_group_ctrl(elt.group)).match_empty_or_deleted();
+            if (free) {
+                elt.slot = elt.group * group_width + std::countr_zero(free);
+                break;
+            }
+            elt.step++;
+            elt.group = (elt.group + elt.step) & _group_mask;
+        }
+        if (_ctrl[elt.slot] == ctrl_empty) {
+            _used++;
+        }
+        _ctrl[elt.slot] = elt.tag;
+        _slots[elt.slot] = index;
+    }
+
+    // a slot can go straight back to empty if its group never filled up,
+    // since then no probe sequence has ever passed through it
+    void bucket_remove (const ProbeElt& elt) {
+        if (ProbeGroup(_group_ctrl(elt.group)).match_empty()) {
+            _ctrl[elt.slot] = ctrl_empty;
+            _used--;
+        } else {
+            _ctrl[elt.slot] = ctrl_deleted;
+        }
+    }
+
+    // renumbers the elements after the set compacted its storage, slots need no resizing
+    void remap_indexes (Span<const index_t> remap, size_type) {
+        for (size_type slot = 0; slot < bucket_count(); slot++) {
+            if (_ctrl[slot] >= 0) {
+                _slots[slot] = remap[_slots[slot]];
+            }
+        }
+    }
+
+    // deleted slots count towards the load, as they lengthen probe sequences just the same
+    bool needs_rehash (size_type, size_type) const {
+        return _used >= bucket_count() - bucket_count() / 8;
+    }
+
+    // grows when mostly full of live elements, otherwise rehashes in place to clear deleted slots
+    size_type rehash_count (size_type count, size_type) const {
+        return count * 2 >= bucket_count() - bucket_count() / 8 ? bucket_count() * 2 : bucket_count();
+    }
+
+    // enough slots to stay under the load limit once count slots are used
+    size_type bucket_count_for (size_type count, size_type) const {
+        return count + count / 7 + 1;
+    }
+
+    size_type bucket_count () const { return _ctrl.size(); }
+
+private:
+
+    static size_t _mix (size_t hash) {
+        uint64_t h = (uint64_t)hash * 0x9E3779B97F4A7C15ull;
+        return h ^ (h >> 32);
+    }
+
+    const int8_t* _group_ctrl (size_type group) const {
+        return _ctrl.data() + group * group_width;
+    }
+
+    BasicVector<ctrl_chunk_type> _ctrl;
+    BasicVector<chunk_type> _slots;
+    size_t _group_mask = 0;
+    size_type _used = 0;
+
+};
+
+using ProbeVector = BasicProbeVector<>;
+
+
+
+} // namespace luna
@@ -0,0 +1,284 @@
+#pragma once
+#include "map.h"
+#include "epoch.h"
+#include <atomic>
+#include <bit>
+#include <mutex>
+#include <optional>
+#include <cassert>
+
+
+namespace luna {
+
+
+
+/**
+ * @brief A thread safe hash map for data that is read far more often than written.
+ * Readers take no lock and do no atomic read-modify-write: they pin an epoch
+ * domain, load the current table and walk its bucket chains, which are atomic
+ * indexes into an array of entries that never change once published.
+ * Writers are serialized by a mutex. They append new entries past the last one and
+ * link them with release stores, and unlink removed or replaced entries, which stay
+ * readable until the whole table is retired. When the entries run out, a writer
+ * copies the live ones into a new table twice their count, publishes it and retires
+ * the old one through the epoch domain, so readers never wait on a rehash.
+ * Reads go through a Reader, which registers its thread with the domain once.
+ */
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>,
+    class _Domain = EpochDomain>
+class BasicReadMostlyMap {
+
+    using entry_type = MapEntry<_Key, _Val>;
+
+    // a published table is only ever appended to and relinked, never moved or freed in place
+    struct Table {
+        explicit Table (index_t __capacity) {
+            capacity = __capacity;
+            bucket_mask = (index_t)std::bit_ceil((unsigned)std::max(__capacity, 2)) - 1;
+            entries.allocate(capacity);
+            hashes.allocate(capacity);
+            next.allocate(capacity);
+            roots.allocate(bucket_mask + 1);
+            for (index_t i = 0; i < capacity; i++) {
+                next.construct(i, nullindex);
+            }
+            for (index_t i = 0; i <= bucket_mask; i++) {
+                roots.construct(i, nullindex);
+            }
+        }
+
+        ~Table () {
+            for (index_t i = count; i-- > 0;) {
+                entries.destroy(i);
+            }
+            entries.deallocate();
+            hashes.deallocate();
+            next.deallocate();
+            roots.deallocate();
+        }
+
+        std::atomic<index_t>& root (size_t hash) { return roots.data()[hash & bucket_mask]; }
+        const std::atomic<index_t>& root (size_t hash) const { return roots.data()[hash & bucket_mask]; }
+
+        HeapArrayChunk<entry_type> entries;
+        HeapArrayChunk<size_t> hashes;
+        HeapArrayChunk<std::atomic<index_t>> next;
+        HeapArrayChunk<std::atomic<index_t>> roots;
+        index_t capacity = 0;
+        index_t bucket_mask = 0;
+        // entries constructed so far, linked or not. only writers touch it
+        index_t count = 0;
+    };
+
+public:
+
+    using key_type = _Key;
+    using value_type = _Val;
+    using size_type = index_t;
+    using hasher = _Hasher;
+    using key_equal = _Equal;
+    using domain_type = _Domain;
+
+    static constexpr size_type min_capacity = 16;
+
+    // the read side of one thread, which must not be shared between threads
+    class Reader {
+    public:
+
+        explicit Reader (const BasicReadMostlyMap& __map)
+        : _map(__map), _reader(__map._domain) {}
+
+        template <class _T>
+        bool contains (const _T& key) const {
+            typename domain_type::Guard guard(_reader);
+            return _map._find(key, hasher{}.hash(key)) != nullptr;
+        }
+
+        // copies the value out, since the entry may be retired as soon as the read ends
+        template <class _T>
+        std::optional<value_type> find (const _T& key) const {
+            typename domain_type::Guard guard(_reader);
+            const entry_type* entry = _map._find(key, hasher{}.hash(key));
+            return entry ? std::optional<value_type>(entry->value) : std::nullopt;
+        }
+
+        // calls fn(const value_type&) while pinned, returns false if the key does not exist
+        template <class _T, class _Fn>
+        bool read (const _T& key, _Fn&& fn) const {
+            typename domain_type::Guard guard(_reader);
+            const entry_type* entry = _map._find(key, hasher{}.hash(key));
+            if (!entry) return false;
+            fn(entry->value);
+            return true;
+        }
+
+        // pins the domain, so several reads share one pin and see tables no older than its start
+        typename domain_type::Guard pin () const { return typename domain_type::Guard(_reader); }
+
+    private:
+
+        const BasicReadMostlyMap& _map;
+        mutable typename domain_type::Reader _reader;
+
+    };
+
+    BasicReadMostlyMap (size_type __capacity = min_capacity) {
+        _table.store(new Table(std::max(__capacity, min_capacity)), std::memory_order_relaxed);
+    }
+
+    BasicReadMostlyMap (const BasicReadMostlyMap&) = delete;
+    BasicReadMostlyMap& operator= (const BasicReadMostlyMap&) = delete;
+
+    // no reader may be left
+    ~BasicReadMostlyMap () {
+        delete _table.load(std::memory_order_relaxed);
+    }
+
+    Reader reader () const { return Reader(*this); }
+
+    // returns true if the key was inserted, false if it already existed
+    template <class... _Args>
+    bool emplace (const key_type& key, _Args&&... args) {
+        size_t hash = hasher{}.hash(key);
+        std::lock_guard lock(_write_mutex);
+        if (_find(key, hash)) return false;
+        Table* table = _reserve_one();
+        index_t index = _append(table, hash, key, std::forward<_Args>(args)...);
+        std::atomic<index_t>& root = table->root(hash);
+        table->next.data()[index].store(root.load(std::memory_order_relaxed), std::memory_order_relaxed);
+        root.store(index, std::memory_order_release);
+        _size.store(_size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    bool insert (const key_type& key, const value_type& val) {
+        return emplace(key, val);
+    }
+
+    // a new entry takes the place of the old one in its chain, so readers see either whole value
+    bool insert_or_assign (const key_type& key, const value_type& val) {
+        size_t hash = hasher{}.hash(key);
+        std::lock_guard lock(_write_mutex);
+        Table* table = _reserve_one();
+        std::atomic<index_t>* link = _link_of(table, key, hash);
+        index_t old = link->load(std::memory_order_relaxed);
+        index_t index = _append(table, hash, key, val);
+        if (old == nullindex) {
+            std::atomic<index_t>& root = table->root(hash);
+            table->next.data()[index].store(root.load(std::memory_order_relaxed), std::memory_order_relaxed);
+            root.store(index, std::memory_order_release);
+            _size.store(_size.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+            return true;
+        }
+        table->next.data()[index].store(table->next.data()[old].load(std::memory_order_relaxed), std::memory_order_relaxed);
+        link->store(index, std::memory_order_release);
+        return false;
+    }
+
+    // the entry is only unlinked, readers already on it carry on along its old link
+    template <class _T>
+    bool remove (const _T& key) {
+        size_t hash = hasher{}.hash(key);
+        std::lock_guard lock(_write_mutex);
+        Table* table = _table.load(std::memory_order_relaxed);
+        std::atomic<index_t>* link = _link_of(table, key, hash);
+        index_t index = link->load(std::memory_order_relaxed);
+        if (index == nullindex) return false;
+        link->store(table->next.data()[index].load(std::memory_order_relaxed), std::memory_order_release);
+        _size.store(_size.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        return true;
+    }
+
+    // a snapshot while writers are running
+    size_type size () const { return _size.load(std::memory_order_relaxed); }
+
+    // retired tables still waiting for readers to move on
+    size_type reclaim () { return _domain.reclaim(); }
+
+    domain_type& domain () const { return _domain; }
+
+private:
+
+    // readers must be pinned, writers hold the write mutex
+    template <class _T>
+    const entry_type* _find (const _T& key, size_t hash) const {
+        const Table* table = _table.load(std::memory_order_acquire);
+        index_t index = table->root(hash).load(std::memory_order_acquire);
+        while (index != nullindex) {
+            const entry_type& entry = table->entries.data()[index];
+            if (table->hashes.data()[index] == hash && key_equal{}.cmp(entry.key, key)) {
+                return &entry;
+            }
+            index = table->next.data()[index].load(std::memory_order_acquire);
+        }
+        return nullptr;
+    }
+
+    // the link pointing at the entry of key, or the null link ending its chain
+    template <class _T>
+    std::atomic<index_t>* _link_of (Table* table, const _T& key, size_t hash) {
+        std::atomic<index_t>* link = &table->root(hash);
+        for (index_t index = link->load(std::memory_order_relaxed); index != nullindex; index = link->load(std::memory_order_relaxed)) {
+            if (table->hashes.data()[index] == hash && key_equal{}.cmp(table->entries.data()[index].key, key)) {
+                break;
+            }
+            link = &table->next.data()[index];
+        }
+        return link;
+    }
+
+    // constructs an unlinked entry, readers cannot reach it until it is linked
+    template <class... _Args>
+    index_t _append (Table* table, size_t hash, const key_type& key, _Args&&... args) {
+        index_t index = table->count++;
+        table->entries.construct(index, key, std::forward<_Args>(args)...);
+        table->hashes.data()[index] = hash;
+        return index;
+    }
+
+    // the current table with room for one more entry, replacing it if it is full
+    Table* _reserve_one () {
+        Table* table = _table.load(std::memory_order_relaxed);
+        if (table->count < table->capacity) return table;
+
+        // entries are copied, as readers may still be reading the old ones
+        Table* grown = new Table(std::max(_size.load(std::memory_order_relaxed) * 2, min_capacity));
+        for (index_t bucket = 0; bucket <= table->bucket_mask; bucket++) {
+            index_t index = table->roots.data()[bucket].load(std::memory_order_relaxed);
+            for (; index != nullindex; index = table->next.data()[index].load(std::memory_order_relaxed)) {
+                const entry_type& entry = table->entries.data()[index];
+                size_t hash = table->hashes.data()[index];
+                index_t copy = _append(grown, hash, entry.key, entry.value);
+                std::atomic<index_t>& root = grown->root(hash);
+                grown->next.data()[copy].store(root.load(std::memory_order_relaxed), std::memory_order_relaxed);
+                root.store(copy, std::memory_order_relaxed);
+            }
+        }
+        _table.store(grown, std::memory_order_release);
+        _domain.retire(table);
+        _domain.reclaim();
+        return grown;
+    }
+
+    std::atomic<Table*> _table;
+    std::atomic<size_type> _size = 0;
+    std::mutex _write_mutex;
+    mutable domain_type _domain;
+
+};
+
+
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>>
+using ReadMostlyMap = BasicReadMostlyMap<_Key, _Val, _Hasher, _Equal>;
+
+
+
+} // namespace luna
@@ -0,0 +1,223 @@
+#pragma once
+#include "map.h"
+#include "parallel.h"
+#include <algorithm>
+#include <concepts>
+
+
+/**
+ * @brief Union, intersection and difference of BasicSets, and joins of BasicMaps on key.
+ * Each operation walks the dense storage of one table and probes the other in
+ * batches, see BasicSet::find_index_batch_hashed. Every element is hashed once,
+ * and that hash is reused to insert it into the output, whose buckets are sized
+ * up front. Both tables must hash and compare their elements the same way.
+ * Given more than one thread, the walked table is split into equal index ranges
+ * probed concurrently, and the output is then filled in index order, so results
+ * do not depend on the thread count.
+ * Each set operation either fills an output set passed in, keeping what it holds,
+ * or returns a new set of the same type as its first operand.
+ */
+
+namespace luna {
+
+
+
+template <class _SetA, class _SetB>
+concept CompatibleSetsC =
+    std::same_as<typename _SetA::value_type, typename _SetB::value_type> &&
+    std::same_as<typename _SetA::hasher, typename _SetB::hasher> &&
+    std::same_as<typename _SetA::key_equal, typename _SetB::key_equal>;
+
+
+// probes dst for the valid elements of src with indexes in [first, last).
+// calls fn(src_index, hash, dst_index) for each, dst_index being nullindex if it is missing
+template <class _Src, class _Dst, class _Fn>
+void _probe_range (const _Src& src, const _Dst& dst, index_t first, index_t last, _Fn&& fn,
+                   const typename _Src::hasher& __hasher, const typename _Src::key_equal& __key_equal) {
+    using value_type = typename _Src::value_type;
+    using dst_index_type = typename _Dst::index_type;
+    constexpr index_t group_size = 32;
+    const value_type* vals[group_size];
+    size_t hashes[group_size];
+    index_t indexes[group_size];
+    dst_index_type found[group_size];
+    index_t count = 0;
+    auto flush = [&]{
+        dst.find_index_batch_hashed(
+            Span<const value_type* const>(vals, count),
+            Span<const size_t>(hashes, count),
+            Span<dst_index_type>(found, count),
+            __key_equal);
+        for (index_t i = 0; i < count; i++) {
+            fn(indexes[i], hashes[i], (index_t)found[i]);
+        }
+        count = 0;
+    };
+    for (index_t i = first; i < last; i++) {
+        if (!src.is_valid(i)) continue;
+        vals[count] = &src.at(i);
+        hashes[count] = __hasher.hash(*vals[count]);
+        indexes[count] = i;
+        if (++count == group_size) {
+            flush();
+        }
+    }
+    if (count) {
+        flush();
+    }
+}
+
+
+// probes dst for every element of src, calling fn(src_index, hash, dst_index) in src index order
+// for those keep(dst_index) accepts. fn is only ever called from the calling thread
+template <class _Src, class _Dst, class _Keep, class _Fn>
+void _probe_matching (const _Src& src, const _Dst& dst, index_t thread_count, _Keep&& keep, _Fn&& fn,
+                      const typename _Src::hasher& __hasher, const typename _Src::key_equal& __key_equal) {
+    constexpr index_t min_range = 4096;
+    index_t full_size = src.full_size();
+    thread_count = std::clamp(thread_count, 1, std::max(full_size / min_range, 1));
+    if (thread_count == 1) {
+        _probe_range(src, dst, 0, full_size, [&](index_t index, size_t hash, index_t found) {
+            if (keep(found)) {
+                fn(index, hash, found);
+            }
+        }, __hasher, __key_equal);
+        return;
+    }
+
+    struct Match {
+        index_t index;
+        index_t found;
+        size_t hash;
+    };
+    Vector<Vector<Match>> matches;
+    matches.reserve(thread_count);
+    for (index_t t = 0; t < thread_count; t++) {
+        matches.emplace_back();
+    }
+    parallel_ranges(full_size, thread_count, [&](index_t t, index_t first, index_t last) {
+        _probe_range(src, dst, first, last, [&](index_t index, size_t hash, index_t found) {
+            if (keep(found)) {
+                matches[t].push_back(Match{ index, found, hash });
+            }
+        }, __hasher, __key_equal);
+    });
+
+    for (const Vector<Match>& thread_matches : matches) {
+        for (const Match& match : thread_matches) {
+            fn(match.index, match.hash, match.found);
+        }
+    }
+}
+
+
+// inserts every element of a or b into out
+template <class _SetA, class _SetB, class _SetOut> requires CompatibleSetsC<_SetA, _SetB> && CompatibleSetsC<_SetA, _SetOut>
+void set_union (const _SetA& a, const _SetB& b, _SetOut& out, index_t thread_count = 1,
+                const typename _SetA::hasher& __hasher = {}, const typename _SetA::key_equal& __key_equal = {}) {
+    out.reserve(out.size() + a.size() + b.size(), __hasher);
+    auto add_rest = [&](const auto& larger, const auto& smaller) {
+        for (const auto& val : larger) {
+            out.insert(val, __hasher, __key_equal);
+        }
+        _probe_matching(smaller, larger, thread_count,
+            [](index_t found) { return found == nullindex; },
+            [&](index_t index, size_t hash, index_t) { out.insert_hashed(smaller.at(index), hash, __hasher, __key_equal); },
+            __hasher, __key_equal);
+    };
+    if (a.size() >= b.size()) {
+        add_rest(a, b);
+    } else {
+        add_rest(b, a);
+    }
+}
+
+
+template <class _SetA, class _SetB> requires CompatibleSetsC<_SetA, _SetB>
+_SetA set_union (const _SetA& a, const _SetB& b, index_t thread_count = 1,
+                 const typename _SetA::hasher& __hasher = {}, const typename _SetA::key_equal& __key_equal = {}) {
+    _SetA out;
+    set_union(a, b, out, thread_count, __hasher, __key_equal);
+    return out;
+}
+
+
+// inserts the elements of a also in b into out
+template <class _SetA, class _SetB, class _SetOut> requires CompatibleSetsC<_SetA, _SetB> && CompatibleSetsC<_SetA, _SetOut>
+void set_intersection (const _SetA& a, const _SetB& b, _SetOut& out, index_t thread_count = 1,
+                       const typename _SetA::hasher& __hasher = {}, const typename _SetA::key_equal& __key_equal = {}) {
+    out.reserve(out.size() + std::min(a.size(), b.size()), __hasher);
+    auto add_common = [&](const auto& larger, const auto& smaller) {
+        _probe_matching(smaller, larger, thread_count,
+            [](index_t found) { return found != nullindex; },
+            [&](index_t index, size_t hash, index_t) { out.insert_hashed(smaller.at(index), hash, __hasher, __key_equal); },
+            __hasher, __key_equal);
+    };
+    if (a.size() >= b.size()) {
+        add_common(a, b);
+    } else {
+        add_common(b, a);
+    }
+}
+
+
+template <class _SetA, class _SetB> requires CompatibleSetsC<_SetA, _SetB>
+_SetA set_intersection (const _SetA& a, const _SetB& b, index_t thread_count = 1,
+                        const typename _SetA::hasher& __hasher = {}, const typename _SetA::key_equal& __key_equal = {}) {
+    _SetA out;
+    set_intersection(a, b, out, thread_count, __hasher, __key_equal);
+    return out;
+}
+
+
+// inserts the elements of a not in b into out.
+// a is always the one walked, as only its elements can end up in the output
+template <class _SetA, class _SetB, class _SetOut> requires CompatibleSetsC<_SetA, _SetB> && CompatibleSetsC<_SetA, _SetOut>
+void set_difference (const _SetA& a, const _SetB& b, _SetOut& out, index_t thread_count = 1,
+                     const typename _SetA::hasher& __hasher = {}, const typename _SetA::key_equal& __key_equal = {}) {
+    out.reserve(out.size() + a.size(), __hasher);
+    _probe_matching(a, b, thread_count,
+        [](index_t found) { return found == nullindex; },
+        [&](index_t index, size_t hash, index_t) { out.insert_hashed(a.at(index), hash, __hasher, __key_equal); },
+        __hasher, __key_equal);
+}
+
+template <class _SetA, class _SetB> requires CompatibleSetsC<_SetA, _SetB>
+_SetA set_difference (const _SetA& a, const _SetB& b, index_t thread_count = 1,
+                      const typename _SetA::hasher& __hasher = {}, const typename _SetA::key_equal& __key_equal = {}) {
+    _SetA out;
+    set_difference(a, b, out, thread_count, __hasher, __key_equal);
+    return out;
+}
+
+
+template <class _MapA, class _MapB>
+concept CompatibleMapsC =
+    std::same_as<typename _MapA::key_type, typename _MapB::key_type> &&
+    std::same_as<typename _MapA::hasher, typename _MapB::hasher> &&
+    std::same_as<typename _MapA::key_equal, typename _MapB::key_equal> &&
+    _MapA::layout == _MapB::layout;
+
+
+// calls fn(const key_type&, const a_value_type&, const b_value_type&) for every key in both a and b,
+// walking the smaller map. fn is only ever called from the calling thread
+template <class _MapA, class _MapB, class _Fn> requires CompatibleMapsC<_MapA, _MapB>
+void map_join (const _MapA& a, const _MapB& b, _Fn&& fn, index_t thread_count = 1,
+               const typename _MapA::hasher& __hasher = {}, const typename _MapA::key_equal& __key_equal = {}) {
+    using set_hasher = typename _MapA::set_type::hasher;
+    using set_key_equal = typename _MapA::set_type::key_equal;
+    auto found = [](index_t found) { return found != nullindex; };
+    if (a.size() <= b.size()) {
+        _probe_matching(a.keys(), b.keys(), thread_count, found, [&](index_t index, size_t, index_t other) {
+            fn(a.key_at(index), a.at_index(index), b.at_index(other));
+        }, set_hasher(__hasher), set_key_equal(__key_equal));
+    } else {
+        _probe_matching(b.keys(), a.keys(), thread_count, found, [&](index_t index, size_t, index_t other) {
+            fn(b.key_at(index), a.at_index(other), b.at_index(index));
+        }, set_hasher(__hasher), set_key_equal(__key_equal));
+    }
+}
+
+
+
+} // namespace luna
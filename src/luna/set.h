@@ -5,6 +5,12 @@
 #include <iterator>
 #include "vector.h"
 #include "dense-vector.h"
+#include "probe-vector.h"
+#include "bucket-reduce.h"
+#include "bloom-filter.h"
+#include "hash.h"
+#include "parallel.h"
+#include <ranges>
 #include <cassert>
 
 
@@ -19,90 +25,466 @@ struct BucketElt {
     size_type index = nullindex;
     size_type prev_index = nullindex;
     size_type bucket = nullindex;
+    size_t hash = 0;
     bool started = false;
 };
 
 
-template <ArrayChunkTypeC<index_t> _Chunk = HeapArrayChunk<index_t>>
+/**
+ * @brief Singly linked bucket chains over the dense element indexes of a set.
+ * With _StoreHash, the full hash of every element is kept alongside its link,
+ * so chain walks skip elements whose hash differs without comparing them,
+ * and rehashing never has to hash an element again.
+ * _Reduce decides how a hash is mapped to a bucket, see bucket-reduce.h.
+ * With _Incremental, a rehash keeps the old buckets alongside the new ones,
+ * and the set moves a few old buckets over on every insert and remove.
+ * The new roots are first cleared a few hundred at a time, the old table serving
+ * every operation meanwhile, so no single operation pays for the whole table.
+ * Old buckets are addressed past the new ones, so a chain is always addressed
+ * by a single bucket index whichever table it is in.
+ * The links and hashes grow the same way: once half full, they are copied into arrays
+ * twice as large a few entries per push_back, every write going to both, so the
+ * bucket index never copies them whole in one operation. The dense storage of the
+ * elements is not the bucket index's, it still grows by its chunk.
+ */
+template <
+    ArrayChunkTypeC<index_t> _Chunk = HeapArrayChunk<index_t>,
+    bool _StoreHash = false,
+    BucketReduceC _Reduce = ModuloReduce,
+    bool _Incremental = false>
 class BasicBucketVector {
 public:
 
     using chunk_type = _Chunk;
     using size_type = index_t;
-
+    using elt_type = BucketElt;
+    using reduce_type = _Reduce;
+    using hash_chunk_type = HeapArrayChunk<size_t,
+        typename std::allocator_traits<typename chunk_type::allocator>::template rebind_alloc<size_t>>;
+
+    static constexpr bool stores_hash = _StoreHash;
+    static constexpr bool incremental = _Incremental;
+    // number of old buckets moved over per operation during an incremental rehash
+    static constexpr size_type migrate_count = 4;
+    // number of new bucket roots cleared per old bucket that would have been moved
+    static constexpr size_type clear_count = 64;
+    // number of links copied into the grown arrays per push_back, and the capacity
+    // below which the arrays simply grow in place
+    static constexpr size_type grow_copy_count = 4;
+    static constexpr size_type grow_min_capacity = 1024;
+
+    // drops any incremental rehash in progress, every element has to be relinked after this
     void resize_buckets (size_type count) {
+        _drop_grown();
         std::fill(_bucket_next.begin(), _bucket_next.end(), nullindex);
         _bucket_roots.clear();
-        _bucket_roots.resize(count, nullindex);
+        _bucket_roots.resize(_reduce.resize(count), nullindex);
+        _old_roots.clear();
+        _new_count = 0;
+        _old_count = 0;
+        _migrated = 0;
+    }
+
+    // keeps every element where it is, they are moved over by migrate
+    void start_rehash (size_type count) requires _Incremental {
+        assert(!is_rehashing());
+        size_type old_count = bucket_count();
+        _old_reduce = _reduce;
+        _new_count = _reduce.resize(count);
+        _old_roots.swap(_bucket_roots);
+        _bucket_roots.clear();
+        _bucket_roots.reserve(_new_count);
+        _old_count = old_count;
+        _migrated = 0;
+    }
+
+    // moves the next few old buckets into the new ones.
+    // hash_fn gives the hash of an element index, unless hashes are stored
+    template <class _HashFn>
+    void migrate (const _HashFn& hash_fn, size_type count = migrate_count) requires _Incremental {
+        if (!_is_cleared()) {
+            size_type cleared = std::min(_bucket_roots.size() + count * clear_count, _new_count);
+            _bucket_roots.resize(cleared, nullindex);
+            return;
+        }
+        for (; count > 0 && _migrated < _old_count; count--, _migrated++) {
+            size_type index = _old_roots[_migrated];
+            while (index != nullindex) {
+                size_type next = _bucket_next[index];
+                size_type bucket;
+                if constexpr (_StoreHash) {
+                    bucket = _reduce.reduce(_hashes[index]);
+                } else {
+                    bucket = _reduce.reduce(hash_fn(index));
+                }
+                _set_next(index, _bucket_roots[bucket]);
+                _bucket_roots[bucket] = index;
+                index = next;
+            }
+        }
+        if (_old_count > 0 && _migrated == _old_count) {
+            BasicVector<chunk_type>().swap(_old_roots);
+            _new_count = 0;
+            _old_count = 0;
+            _migrated = 0;
+        }
     }
 
-    BucketElt bucket_start (size_type bucket) const {
+    bool is_rehashing () const { return _old_count > 0; }
+
+    BucketElt bucket_start (size_t hash) const {
         return BucketElt{
             .index = nullindex,
             .prev_index = nullindex,
-            .bucket = bucket,
+            .bucket = _bucket_of(hash),
+            .hash = hash,
             .started = false
         };
     }
 
-    bool get (BucketElt& elt) const {
+    // prefetches whatever the next get reads
+    void prefetch_bucket (const BucketElt& elt) const {
         if (!elt.started) {
-            elt.started = true;
-            elt.index = _bucket_roots[elt.bucket];
-        } else {
-            elt.prev_index = elt.index;
-            elt.index = _bucket_next[elt.index];
+            prefetch(&_root(elt.bucket));
+        } else if (elt.index != nullindex) {
+            prefetch(&_bucket_next[elt.index]);
         }
+    }
+
+    bool get (BucketElt& elt) const {
+        do {
+            if (!elt.started) {
+                elt.started = true;
+                elt.index = _root(elt.bucket);
+            } else {
+                elt.prev_index = elt.index;
+                elt.index = _bucket_next[elt.index];
+            }
+        } while (elt.index != nullindex && !_hash_matches(elt));
         return elt.index != nullindex;
     }
 
     size_type push_back () {
+        if constexpr (_Incremental) {
+            _grow_step();
+        }
         _bucket_next.push_back(nullindex);
+        if constexpr (_StoreHash) {
+            _hashes.push_back(0);
+        }
         return _bucket_next.size() - 1;
     }
 
     void bucket_append (const BucketElt& elt, size_type index) {
         assert(elt.at_end());
+        _set_hash(index, elt.hash);
+        _set_prev_index(elt, index);
+    }
+
+    // links index right in front of elt, keeping it next to the elements equal to elt.
+    // past the end of a chain, this is the same as bucket_append
+    void bucket_link_before (const BucketElt& elt, size_type index) {
+        _set_hash(index, elt.hash);
+        _set_next(index, elt.index);
         _set_prev_index(elt, index);
     }
 
+    // links an element known not to be in the table, without walking its chain
+    void bucket_insert (size_t hash, size_type index) {
+        _set_hash(index, hash);
+        size_type bucket = _bucket_of(hash);
+        _set_next(index, _root(bucket));
+        _root(bucket) = index;
+    }
+
+    // links every element with is_valid(index) at once, right after resize_buckets.
+    // elements are split into ranges and scattered by the range of buckets they fall in,
+    // then each thread links one range of buckets, so no two threads write the same link.
+    // chains end up in the same order as linking the elements one by one with bucket_insert
+    template <class _Valid>
+    void bucket_insert_parallel (Span<const size_t> hashes, _Valid&& is_valid, size_type thread_count) {
+        assert(!is_rehashing());
+        size_type count = hashes.size();
+        size_type buckets = bucket_count();
+        _drop_grown();
+        _bucket_next.clear();
+        _bucket_next.resize(count, nullindex);
+        if constexpr (_StoreHash) {
+            _hashes.clear();
+            _hashes.resize(count, 0);
+        }
+
+        auto part_of = [&](size_type bucket) {
+            return (size_type)((int64_t)bucket * thread_count / buckets);
+        };
+        BasicVector<chunk_type> element_buckets(count, nullindex);
+        // offsets[t * thread_count + p] is where thread t scatters its elements of bucket range p
+        BasicVector<chunk_type> offsets(thread_count * thread_count + 1, 0);
+        parallel_ranges(count, thread_count, [&](index_t t, index_t first, index_t last) {
+            size_type* counts = offsets.data() + t * thread_count;
+            for (size_type i = first; i < last; i++) {
+                if (!is_valid(i)) continue;
+                size_t hash = hashes[i];
+                size_type bucket = _reduce.reduce(hash);
+                element_buckets[i] = bucket;
+                counts[part_of(bucket)]++;
+                if constexpr (_StoreHash) {
+                    _hashes[i] = hash;
+                }
+            }
+        });
+
+        BasicVector<chunk_type> part_starts(thread_count + 1, 0);
+        size_type total = 0;
+        for (size_type p = 0; p < thread_count; p++) {
+            part_starts[p] = total;
+            for (size_type t = 0; t < thread_count; t++) {
+                size_type part_count = offsets[t * thread_count + p];
+                offsets[t * thread_count + p] = total;
+                total += part_count;
+            }
+        }
+        part_starts[thread_count] = total;
+
+        BasicVector<chunk_type> order(total, nullindex);
+        parallel_ranges(count, thread_count, [&](index_t t, index_t first, index_t last) {
+            size_type* next_offsets = offsets.data() + t * thread_count;
+            for (size_type i = first; i < last; i++) {
+                if (element_buckets[i] != nullindex) {
+                    order[next_offsets[part_of(element_buckets[i])]++] = i;
+                }
+            }
+        });
+
+        parallel_run(thread_count, [&](index_t p) {
+            for (size_type k = part_starts[p]; k < part_starts[p + 1]; k++) {
+                size_type index = order[k];
+                size_type bucket = element_buckets[index];
+                _bucket_next[index] = _bucket_roots[bucket];
+                _bucket_roots[bucket] = index;
+            }
+        });
+    }
+
     void bucket_remove (const BucketElt& elt) {
         _set_prev_index(elt, _bucket_next[elt.index]);
-        _bucket_next[elt.index] = nullindex;
+        _set_next(elt.index, nullindex);
+    }
+
+    // renumbers the elements after the set compacted its storage, remap holding
+    // the new index of every old one. chains keep their order, nothing is rehashed
+    void remap_indexes (Span<const index_t> remap, size_type count) {
+        _drop_grown();
+        for (BasicVector<chunk_type>* roots : { &_bucket_roots, &_old_roots }) {
+            for (index_t& root : *roots) {
+                if (root != nullindex) {
+                    root = remap[root];
+                }
+            }
+        }
+        // new indexes never exceed old ones, so every entry is read before it is overwritten
+        for (size_type i = 0; i < remap.size(); i++) {
+            size_type index = remap[i];
+            if (index == nullindex) continue;
+            size_type next = _bucket_next[i];
+            _bucket_next[index] = next == nullindex ? nullindex : remap[next];
+            if constexpr (_StoreHash) {
+                _hashes[index] = _hashes[i];
+            }
+        }
+        _bucket_next.resize(count);
+        _bucket_next.shrink_to_fit();
+        if constexpr (_StoreHash) {
+            _hashes.resize(count);
+            _hashes.shrink_to_fit();
+        }
+    }
+
+    size_t stored_hash (size_type index) const requires _StoreHash {
+        return _hashes[index];
+    }
+
+    bool needs_rehash (size_type count, size_type max_depth) const {
+        return count > bucket_count() * max_depth;
+    }
+
+    size_type rehash_count (size_type, size_type resize_scaler) const {
+        return bucket_count() * resize_scaler;
+    }
+
+    // the fewest buckets that hold count elements without needing a rehash
+    size_type bucket_count_for (size_type count, size_type max_depth) const {
+        return (count + max_depth - 1) / max_depth;
     }
 
-    size_type bucket_count () const { return _bucket_roots.size(); }
+    size_type bucket_count () const { return is_rehashing() ? _new_count : _bucket_roots.size(); }
     size_type size () const { return _bucket_next.size(); }
 
 private:
 
+    // old buckets that have not been moved over yet are still searched in place
+    size_type _bucket_of (size_t hash) const {
+        if constexpr (_Incremental) {
+            if (is_rehashing()) {
+                size_type old_bucket = _old_reduce.reduce(hash);
+                if (old_bucket >= _migrated || !_is_cleared()) {
+                    return bucket_count() + old_bucket;
+                }
+            }
+        }
+        return _reduce.reduce(hash);
+    }
+
+    // whether every new bucket root is cleared, so old buckets can be moved over
+    bool _is_cleared () const { return _bucket_roots.size() == _new_count; }
+
+    index_t& _root (size_type bucket) {
+        if constexpr (_Incremental) {
+            if (bucket >= bucket_count()) {
+                return _old_roots[bucket - bucket_count()];
+            }
+        }
+        return _bucket_roots[bucket];
+    }
+    const index_t& _root (size_type bucket) const {
+        if constexpr (_Incremental) {
+            if (bucket >= bucket_count()) {
+                return _old_roots[bucket - bucket_count()];
+            }
+        }
+        return _bucket_roots[bucket];
+    }
+
+    struct NoHashes {};
+    using hashes_type = std::conditional_t<_StoreHash, BasicVector<hash_chunk_type>, NoHashes>;
+
+    bool _hash_matches (const BucketElt& elt) const {
+        if constexpr (_StoreHash) {
+            return _hashes[elt.index] == elt.hash;
+        } else {
+            return true;
+        }
+    }
+
+    void _set_hash (size_type index, size_t hash) {
+        if (index == size()) {
+            push_back();
+        }
+        if constexpr (_StoreHash) {
+            _hashes[index] = hash;
+            if (_Incremental && index < _grown_next.size()) {
+                _grown_hashes[index] = hash;
+            }
+        }
+    }
+
     void _set_prev_index (const BucketElt& elt, size_type index) {
         if (elt.prev_index == nullindex) {
-            // assert(_bucket_roots[elt.bucket] != nullindex);
-            _bucket_roots[elt.bucket] = index;
+            _root(elt.bucket) = index;
         } else {
-            _bucket_next[elt.prev_index] = index;
+            _set_next(elt.prev_index, index);
+        }
+    }
+
+    // links already copied into the grown array are written there too
+    void _set_next (size_type index, size_type next) {
+        _bucket_next[index] = next;
+        if constexpr (_Incremental) {
+            if (index < _grown_next.size()) {
+                _grown_next[index] = next;
+            }
+        }
+    }
+
+    // starts copying the links into an array twice as large once they are half full,
+    // which a few entries per push_back completes well before they are full
+    void _grow_step () {
+        if (_grown_next.capacity() == 0) {
+            size_type capacity = _bucket_next.capacity();
+            if (capacity < grow_min_capacity || _bucket_next.size() < capacity / 2) return;
+            _grown_next.reserve(capacity * 2);
+            if constexpr (_StoreHash) {
+                _grown_hashes.reserve(capacity * 2);
+            }
+        }
+        size_type last = std::min(_grown_next.size() + grow_copy_count, _bucket_next.size());
+        for (size_type i = _grown_next.size(); i < last; i++) {
+            _grown_next.push_back(_bucket_next[i]);
+            if constexpr (_StoreHash) {
+                _grown_hashes.push_back(_hashes[i]);
+            }
+        }
+        if (_grown_next.size() == _bucket_next.size()) {
+            _bucket_next.swap(_grown_next);
+            if constexpr (_StoreHash) {
+                _hashes.swap(_grown_hashes);
+            }
+            _drop_grown();
+        }
+    }
+
+    void _drop_grown () {
+        BasicVector<chunk_type>().swap(_grown_next);
+        if constexpr (_StoreHash) {
+            BasicVector<hash_chunk_type>().swap(_grown_hashes);
         }
     }
 
     BasicVector<chunk_type> _bucket_roots;
+    // the roots of the old buckets during an incremental rehash
+    BasicVector<chunk_type> _old_roots;
     BasicVector<chunk_type> _bucket_next;
+    [[no_unique_address]] hashes_type _hashes;
+    // the links and hashes being copied into larger arrays, see _grow_step
+    BasicVector<chunk_type> _grown_next;
+    [[no_unique_address]] hashes_type _grown_hashes;
+    _Reduce _reduce;
+    _Reduce _old_reduce;
+    size_type _new_count = 0;
+    size_type _old_count = 0;
+    size_type _migrated = 0;
 
 };
 
 using BucketVector = BasicBucketVector<>;
+using HashedBucketVector = BasicBucketVector<HeapArrayChunk<index_t>, true>;
+using IncrementalBucketVector = BasicBucketVector<HeapArrayChunk<index_t>, false, ModuloReduce, true>;
+using BloomBucketVector = BasicBloomBuckets<BucketVector>;
+
+
+// the index structure a set resolves lookups through, mapping hashes to dense element indexes
+template <class _Buckets>
+concept BucketVectorC = requires (_Buckets buckets, const _Buckets& cbuckets, typename _Buckets::elt_type elt, size_t hash, index_t n) {
+    buckets.resize_buckets(n);
+    { cbuckets.bucket_start(hash) } -> std::same_as<typename _Buckets::elt_type>;
+    { cbuckets.get(elt) } -> std::convertible_to<bool>;
+    cbuckets.prefetch_bucket(elt);
+    { elt.at_end() } -> std::convertible_to<bool>;
+    { elt.index } -> std::convertible_to<index_t>;
+    buckets.bucket_append(elt, n);
+    buckets.bucket_insert(hash, n);
+    buckets.bucket_remove(elt);
+    { cbuckets.needs_rehash(n, n) } -> std::convertible_to<bool>;
+    { cbuckets.rehash_count(n, n) } -> std::convertible_to<index_t>;
+    { cbuckets.bucket_count_for(n, n) } -> std::convertible_to<index_t>;
+    buckets.remap_indexes(Span<const index_t>(), n);
+    { cbuckets.bucket_count() } -> std::convertible_to<index_t>;
+};
 
 
 
 template <
     ArrayChunk _Chunk,
     ArrayChunkTypeC<index_t> _IndexChunk,
-    HasherC<typename _Chunk::value_type> _Hasher = BasicHasher<typename _Chunk::value_type>,
-    CompareC<typename _Chunk::value_type, typename _Chunk::value_type> _Equal = BasicCmp<typename _Chunk::value_type>>
+    HasherC<typename _Chunk::value_type> _Hasher = DefaultHasher<typename _Chunk::value_type>,
+    CompareC<typename _Chunk::value_type, typename _Chunk::value_type> _Equal = BasicCmp<typename _Chunk::value_type>,
+    BucketVectorC _Buckets = BasicBucketVector<_IndexChunk>>
 class BasicSet {
 public:
 
     using container_type = BasicDenseVector<_Chunk>;
+    using buckets_type = _Buckets;
+    using bucket_elt_type = typename buckets_type::elt_type;
     using value_type = typename container_type::value_type;
     using size_type = index_t;
     using index_type = Index<value_type>;
@@ -125,17 +507,40 @@ public:
         _buckets.resize_buckets(__bucket_count);
     }
 
+    // see build_from
+    template <std::ranges::input_range _Range>
+    BasicSet (const _Range& range, const ParallelPolicy& policy, const _Hasher& __hasher = {}, const _Equal& __key_equal = {})
+    : BasicSet() {
+        build_from(range, policy, __hasher, __key_equal);
+    }
+
+    // the hash this set uses for a value, to be passed to the _hashed functions.
+    // it stays valid across rehashes, and for any set using the same hasher
+    template <class _T>
+    size_t hash_of (const _T& val, const _Hasher& __hasher = {}) const {
+        return __hasher.hash(val);
+    }
+
     std::pair<index_type, bool> insert (const value_type& val, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
-        BucketElt bucket_elt = _find_bucket_elt(val, __hasher, __key_equal);
+        return insert_hashed(val, __hasher.hash(val), __hasher, __key_equal);
+    }
+
+    // hash must be hash_of(val). the hasher is still needed to rehash other elements
+    std::pair<index_type, bool> insert_hashed (const value_type& val, size_t hash, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        return emplace_hashed(val, hash, __hasher, __key_equal, val);
+    }
+
+    // looks up key, and only if it is missing constructs an element from args,
+    // which must compare equal to key
+    template <class _T, class... _Args>
+    std::pair<index_type, bool> emplace_hashed (const _T& key, size_t hash, const _Hasher& __hasher, const _Equal& __key_equal, _Args&&... args) {
+        _migrate(__hasher);
+        bucket_elt_type bucket_elt = _find_bucket_elt(key, hash, __key_equal);
         if (bucket_elt.at_end()) {
-            assert(_buckets.size() >= _elts.next_index());
-            if (maybe_rehash()) {
-                bucket_elt = _find_bucket_elt(val, __hasher, __key_equal);
+            if (maybe_rehash(__hasher)) {
+                bucket_elt = _find_bucket_elt(key, hash, __key_equal);
             }
-            if (_buckets.size() == _elts.next_index()) {
-                _buckets.push_back();
-            }
-            index_type index = _elts.push_back(val);
+            index_type index = _elts.emplace_back(std::forward<_Args>(args)...);
             _buckets.bucket_append(bucket_elt, index);
             return std::make_pair(index, true);
         }
@@ -145,7 +550,13 @@ public:
     // remove an element. returns index of removed object, nullptr if it didn't exisst
     template <class _T>
     index_type remove (const _T& val, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
-        BucketElt elt = _find_bucket_elt(val, __hasher, __key_equal);
+        return remove_hashed(val, __hasher.hash(val), __hasher, __key_equal);
+    }
+
+    template <class _T>
+    index_type remove_hashed (const _T& val, size_t hash, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        _migrate(__hasher);
+        bucket_elt_type elt = _find_bucket_elt(val, hash, __key_equal);
         if (elt.index == nullindex) return nullindex;
         _buckets.bucket_remove(elt);
         _elts.remove(elt.index);
@@ -156,34 +567,196 @@ public:
     template <class _T>
     value_type* find (const _T& val, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
         index_type index = find_index(val, __hasher, __key_equal);
-        return index == nullindex ? nullptr : at(index);
+        return index == nullindex ? nullptr : &at(index);
     }
 
     // get a pointer to an element, returns nullptr if it doe snot exist
     template <class _T>
     const value_type* find (const _T& val, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
         index_type index = find_index(val, __hasher, __key_equal);
-        return index == nullindex ? nullptr : at(index);
+        return index == nullindex ? nullptr : &at(index);
+    }
+
+    template <class _T>
+    value_type* find_hashed (const _T& val, size_t hash, const _Equal& __key_equal = {}) {
+        index_type index = find_index_hashed(val, hash, __key_equal);
+        return index == nullindex ? nullptr : &at(index);
+    }
+
+    template <class _T>
+    const value_type* find_hashed (const _T& val, size_t hash, const _Equal& __key_equal = {}) const {
+        index_type index = find_index_hashed(val, hash, __key_equal);
+        return index == nullindex ? nullptr : &at(index);
     }
 
     // find the index of a value, returns nullindex if it does not exist
     template <class _T>
     index_type find_index (const _T& val, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
-        return _find_bucket_elt(val, __hasher, __key_equal).index;
+        return _find_bucket_elt(val, __hasher.hash(val), __key_equal).index;
+    }
+
+    template <class _T>
+    index_type find_index_hashed (const _T& val, size_t hash, const _Equal& __key_equal = {}) const {
+        return _find_bucket_elt(val, hash, __key_equal).index;
+    }
+
+    // finds the indexes of a batch of values, writing nullindex for those that do not exist.
+    // lookups are done in groups, each stage touching one level of the table for the
+    // whole group before the next, so the cache misses of a group overlap
+    template <class _T>
+    void find_index_batch (Span<const _T> vals, Span<index_type> out, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        assert(out.size() >= vals.size());
+        constexpr size_type group_size = 32;
+        const _T* group_vals[group_size];
+        size_t hashes[group_size];
+        for (size_type first = 0; first < vals.size(); first += group_size) {
+            size_type count = std::min(group_size, vals.size() - first);
+            for (size_type i = 0; i < count; i++) {
+                group_vals[i] = vals.data() + first + i;
+                hashes[i] = __hasher.hash(*group_vals[i]);
+            }
+            find_index_batch_hashed(
+                Span<const _T* const>(group_vals, count),
+                Span<const size_t>(hashes, count),
+                Span<index_type>(out.data() + first, count),
+                __key_equal);
+        }
     }
 
-    void rehash (size_type __bucket_count, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+    // like find_index_batch, for values that are not contiguous and already hashed
+    template <class _T>
+    void find_index_batch_hashed (Span<const _T* const> vals, Span<const size_t> hashes, Span<index_type> out, const _Equal& __key_equal = {}) const {
+        assert(hashes.size() >= vals.size() && out.size() >= vals.size());
+        constexpr size_type group_size = 32;
+        bucket_elt_type elts[group_size];
+        for (size_type first = 0; first < vals.size(); first += group_size) {
+            size_type count = std::min(group_size, vals.size() - first);
+            const _T* const* group_vals = vals.data() + first;
+            for (size_type i = 0; i < count; i++) {
+                elts[i] = _buckets.bucket_start(hashes.data()[first + i]);
+                _buckets.prefetch_bucket(elts[i]);
+            }
+            for (size_type i = 0; i < count; i++) {
+                if (_buckets.get(elts[i])) {
+                    prefetch(&_elts[elts[i].index]);
+                    _buckets.prefetch_bucket(elts[i]);
+                }
+            }
+            for (size_type i = 0; i < count; i++) {
+                bucket_elt_type& elt = elts[i];
+                while (elt.index != nullindex && !__key_equal.cmp(_elts[elt.index], *group_vals[i])) {
+                    _buckets.get(elt);
+                }
+                out.data()[first + i] = elt.index;
+            }
+        }
+    }
+
+    template <class _T>
+    void contains_batch (Span<const _T> vals, Span<bool> out, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) const {
+        assert(out.size() >= vals.size());
+        constexpr size_type group_size = 64;
+        index_type indexes[group_size];
+        for (size_type first = 0; first < vals.size(); first += group_size) {
+            size_type count = std::min(group_size, vals.size() - first);
+            find_index_batch(Span<const _T>(vals.data() + first, count), Span<index_type>(indexes, count), __hasher, __key_equal);
+            for (size_type i = 0; i < count; i++) {
+                out.data()[first + i] = indexes[i] != nullindex;
+            }
+        }
+    }
+
+    // elements are already unique, so they are relinked without being compared
+    void rehash (size_type __bucket_count, const _Hasher& __hasher = {}, const _Equal& = {}) {
         _buckets.resize_buckets(__bucket_count);
         for (auto [i, val] : _elts.ipairs()) {
-            BucketElt elt = _find_bucket_elt(val, __hasher, __key_equal);
-            _buckets.bucket_append(elt, i);
+            if constexpr (_stores_hash()) {
+                _buckets.bucket_insert(_buckets.stored_hash(i), i);
+            } else {
+                _buckets.bucket_insert(__hasher.hash(val), i);
+            }
         }
     }
 
-    bool maybe_rehash () {
-        if (_elts.size() <= bucket_count() * _max_depth)
+    // rehashes on policy.thread_count threads. hashing is always split between them,
+    // linking only when the buckets support it, otherwise it is done serially
+    void rehash (size_type __bucket_count, const ParallelPolicy& policy, const _Hasher& __hasher = {}) {
+        Vector<size_t> hashes;
+        _hash_all(hashes, policy, __hasher, true);
+        _rehash_hashed(__bucket_count, hashes, policy);
+    }
+
+    // replaces the contents of the set with the elements of range, keeping the first of any
+    // duplicates. the elements are copied in serially, everything after is split over
+    // policy.thread_count threads, like rehash with a ParallelPolicy
+    template <std::ranges::input_range _Range>
+    void build_from (const _Range& range, const ParallelPolicy& policy, const _Hasher& __hasher = {}, const _Equal& __key_equal = {}) {
+        _elts.clear();
+        if constexpr (std::ranges::sized_range<_Range>) {
+            _elts.reserve(std::ranges::size(range));
+        }
+        for (const auto& val : range) {
+            _elts.emplace_back(val);
+        }
+        Vector<size_t> hashes;
+        _hash_all(hashes, policy, __hasher, false);
+        // one element per bucket, as inserting them one by one would have grown to about as many
+        _rehash_hashed(std::max(bucket_count(), _buckets.bucket_count_for(_elts.size(), 1)), hashes, policy);
+        _remove_duplicates(hashes, policy, __key_equal);
+    }
+
+    // makes room for count elements, so that inserting up to count elements does not rehash
+    void reserve (size_type count, const _Hasher& __hasher = {}) {
+        _elts.reserve(count);
+        size_type buckets = _buckets.bucket_count_for(count, _max_depth);
+        if (buckets > bucket_count()) {
+            rehash(buckets, __hasher);
+        }
+    }
+
+    // closes the holes left by removed elements, see BasicDenseVector::compact.
+    // the buckets are renumbered in place rather than rehashed
+    template <class _Fn>
+    void compact (_Fn&& fn) {
+        Vector<index_t> remap(_elts.full_size(), nullindex);
+        _elts.compact([&](index_type old_index, index_type new_index) {
+            remap[(index_t)old_index] = new_index;
+            fn(old_index, new_index);
+        });
+        _buckets.remap_indexes(Span<const index_t>(remap.data(), remap.size()), _elts.size());
+    }
+
+    void compact () {
+        compact([](index_type, index_type) {});
+    }
+
+    // with incremental buckets this only starts the rehash, finishing any previous one first
+    bool maybe_rehash (const _Hasher& __hasher = {}) {
+        if (!_buckets.needs_rehash(_elts.size(), _max_depth)) {
+            // buckets with a side structure that goes stale, like a Bloom filter, refill it
+            // from the element hashes. nothing is relinked, so lookups made before stay valid
+            if constexpr (requires { _buckets.needs_rebuild(); }) {
+                if (_buckets.needs_rebuild()) {
+                    _buckets.reset_filter();
+                    for (auto [i, val] : _elts.ipairs()) {
+                        if constexpr (_stores_hash()) {
+                            _buckets.filter_add(_buckets.stored_hash(i));
+                        } else {
+                            _buckets.filter_add(__hasher.hash(val));
+                        }
+                    }
+                }
+            }
             return false;
-        rehash(bucket_count() * _resize_scaler);
+        }
+        if constexpr (_is_incremental()) {
+            while (_buckets.is_rehashing()) {
+                _migrate(__hasher);
+            }
+            _buckets.start_rehash(_buckets.rehash_count(_elts.size(), _resize_scaler));
+        } else {
+            rehash(_buckets.rehash_count(_elts.size(), _resize_scaler), __hasher);
+        }
         return true;
     }
 
@@ -196,6 +769,9 @@ public:
     const_iterator end () const { return _elts.end(); }
 
     size_type size () const { return _elts.size(); }
+    // size including removed elements, the bound of valid indexes
+    size_type full_size () const { return _elts.full_size(); }
+    bool is_valid (index_type index) const { return _elts.is_valid(index); }
 
     auto ipairs () { return _elts.ipairs(); }
     auto ipairs () const { return _elts.ipairs(); }
@@ -207,16 +783,103 @@ public:
     const value_type* data () const { return _elts.data(); }
     const value_type* data_end () const { return _elts.data_end(); }
 
+    const size_type* remove_chain_data () const { return _elts.remove_chain_data(); }
+    const size_type* remove_chain_data_end () const { return _elts.remove_chain_data_end(); }
+
 private:
 
-    template <class _T>
-    size_type _get_bucket (const _T& val, const _Hasher& __hasher) const {
-        return __hasher.hash(val) % _buckets.bucket_count();
+    static constexpr bool _stores_hash () {
+        if constexpr (requires { buckets_type::stores_hash; }) {
+            return buckets_type::stores_hash;
+        } else {
+            return false;
+        }
+    }
+
+    static constexpr bool _is_incremental () {
+        if constexpr (requires { buckets_type::incremental; }) {
+            return buckets_type::incremental;
+        } else {
+            return false;
+        }
+    }
+
+    void _migrate (const _Hasher& __hasher) {
+        if constexpr (_is_incremental()) {
+            if (_buckets.is_rehashing()) {
+                _buckets.migrate([&](index_type index) { return __hasher.hash(_elts[index]); });
+            }
+        }
+    }
+
+    // stored hashes are only there for elements that have been linked before
+    void _hash_all (Vector<size_t>& hashes, const ParallelPolicy& policy, const _Hasher& __hasher, bool use_stored) const {
+        hashes.resize(_elts.full_size());
+        parallel_ranges(_elts.full_size(), policy.thread_count, [&](index_t, index_t first, index_t last) {
+            for (size_type i = first; i < last; i++) {
+                if (!_elts.is_valid(i)) continue;
+                if constexpr (_stores_hash()) {
+                    if (use_stored) {
+                        hashes[i] = _buckets.stored_hash(i);
+                        continue;
+                    }
+                }
+                hashes[i] = __hasher.hash(_elts[i]);
+            }
+        });
+    }
+
+    void _rehash_hashed (size_type __bucket_count, const Vector<size_t>& hashes, const ParallelPolicy& policy) {
+        _buckets.resize_buckets(__bucket_count);
+        Span<const size_t> hash_span(hashes.data(), hashes.size());
+        auto is_valid = [&](index_t i) { return _elts.is_valid(i); };
+        if constexpr (requires { _buckets.bucket_insert_parallel(hash_span, is_valid, policy.thread_count); }) {
+            // scattering only pays off once there is more than one thread to link
+            if (policy.thread_count > 1) {
+                _buckets.bucket_insert_parallel(hash_span, is_valid, policy.thread_count);
+                return;
+            }
+        }
+        for (size_type i = 0; i < _elts.full_size(); i++) {
+            if (is_valid(i)) {
+                _buckets.bucket_insert(hashes[i], i);
+            }
+        }
+    }
+
+    // every element is checked against its bucket on its own thread, an element being a duplicate
+    // if an equal one has a lower index. only the duplicates are then unlinked and removed serially
+    void _remove_duplicates (const Vector<size_t>& hashes, const ParallelPolicy& policy, const _Equal& __key_equal) {
+        Vector<Vector<index_t>> duplicates;
+        duplicates.reserve(policy.thread_count);
+        for (size_type t = 0; t < policy.thread_count; t++) {
+            duplicates.emplace_back();
+        }
+        parallel_ranges(_elts.full_size(), policy.thread_count, [&](index_t t, index_t first, index_t last) {
+            for (size_type i = first; i < last; i++) {
+                if (!_elts.is_valid(i)) continue;
+                bucket_elt_type elt = _buckets.bucket_start(hashes[i]);
+                while (_buckets.get(elt)) {
+                    if (elt.index < i && __key_equal.cmp(_elts[elt.index], _elts[i])) {
+                        duplicates[t].push_back(i);
+                        break;
+                    }
+                }
+            }
+        });
+        for (const Vector<index_t>& thread_duplicates : duplicates) {
+            for (index_t index : thread_duplicates) {
+                bucket_elt_type elt = _buckets.bucket_start(hashes[index]);
+                while (_buckets.get(elt) && elt.index != index) {}
+                _buckets.bucket_remove(elt);
+                _elts.remove(index);
+            }
+        }
     }
 
     template <class _T>
-    BucketElt _find_bucket_elt (const _T& val, const _Hasher& __hasher, const _Equal& __cmp) const {
-        BucketElt bucket_elt = _buckets.bucket_start(_get_bucket(val, __hasher));
+    bucket_elt_type _find_bucket_elt (const _T& val, size_t hash, const _Equal& __cmp) const {
+        bucket_elt_type bucket_elt = _buckets.bucket_start(hash);
         while (_buckets.get(bucket_elt)) {
             if (__cmp.cmp(_elts[bucket_elt.index], val)) {
                 return bucket_elt;
@@ -225,7 +888,7 @@ private:
         return bucket_elt;
     }
 
-    BasicBucketVector<_IndexChunk> _buckets;
+    buckets_type _buckets;
     container_type _elts;
     
     size_type _max_depth = 4;
@@ -235,10 +898,34 @@ private:
 
 
 template <class T, 
-    HasherC<T> _Hasher = BasicHasher<T>,
+    HasherC<T> _Hasher = DefaultHasher<T>,
     CompareC<T, T> _Equal = BasicCmp<T>>
 using Set = BasicSet<HeapArrayChunk<T>, HeapArrayChunk<index_t>, _Hasher, _Equal>;
 
+// a set mixing its hashes with FastHasher, see hash.h
+template <class T, 
+    CompareC<T, T> _Equal = BasicCmp<T>>
+using FastSet = Set<T, FastHasher<T>, _Equal>;
+
+// a set using open addressing with probed control bytes instead of bucket chains
+template <class T, 
+    HasherC<T> _Hasher = DefaultHasher<T>,
+    CompareC<T, T> _Equal = BasicCmp<T>>
+using ProbeSet = BasicSet<HeapArrayChunk<T>, HeapArrayChunk<index_t>, _Hasher, _Equal, ProbeVector>;
+
+// a set keeping the hash of every element, for keys that are expensive to hash or compare
+template <class T, 
+    HasherC<T> _Hasher = DefaultHasher<T>,
+    CompareC<T, T> _Equal = BasicCmp<T>>
+using HashedSet = BasicSet<HeapArrayChunk<T>, HeapArrayChunk<index_t>, _Hasher, _Equal, HashedBucketVector>;
+
+// a set spreading the cost of a rehash over the inserts and removes following it.
+// its elements still grow by copying, see BasicBucketVector
+template <class T, 
+    HasherC<T> _Hasher = DefaultHasher<T>,
+    CompareC<T, T> _Equal = BasicCmp<T>>
+using IncrementalSet = BasicSet<HeapArrayChunk<T>, HeapArrayChunk<index_t>, _Hasher, _Equal, IncrementalBucketVector>;
+
 
 
 
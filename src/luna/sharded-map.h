@@ -0,0 +1,187 @@
+#pragma once
+#include "map.h"
+#include "array.h"
+#include <shared_mutex>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <optional>
+#include <bit>
+
+
+namespace luna {
+
+
+
+/**
+ * @brief A thread safe map made of _ShardCount independent maps, each behind
+ * its own reader/writer lock. Keys are sent to a shard by the high bits of
+ * their hash, leaving the low bits to the bucket index of the shard itself.
+ * Values are only ever handed out while their shard is locked, through read
+ * and update, or copied out by find.
+ * Every operation hashes its key once, and reuses the hash inside the shard.
+ */
+template <class _Map, index_t _ShardCount = 64>
+class BasicShardedMap {
+public:
+
+    static_assert(std::has_single_bit((unsigned)_ShardCount), "shard count must be a power of two");
+
+    using map_type = _Map;
+    using key_type = typename map_type::key_type;
+    using value_type = typename map_type::value_type;
+    using hasher = typename map_type::hasher;
+    using key_equal = typename map_type::key_equal;
+    using size_type = index_t;
+
+    static constexpr size_type shard_count () { return _ShardCount; }
+
+    template <class _T>
+    size_type shard_of (const _T& key, const hasher& hash = {}) const {
+        return shard_of_hash(hash.hash(key));
+    }
+
+    size_type shard_of_hash (size_t key_hash) const {
+        if constexpr (_ShardCount == 1) {
+            return 0;
+        } else {
+            return ((uint64_t)key_hash * 11400714819323198485ull) >> (64 - std::countr_zero((unsigned)_ShardCount));
+        }
+    }
+
+    // returns true if the key was inserted, false if it already existed
+    template <class... _Args>
+    bool emplace (const key_type& key, _Args&&... args) {
+        size_t key_hash = hasher{}.hash(key);
+        Shard& shard = _shards[shard_of_hash(key_hash)];
+        std::unique_lock lock(shard.mutex);
+        return shard.map.emplace_hashed(key_hash, key, std::forward<_Args>(args)...).second;
+    }
+
+    bool insert (const key_type& key, const value_type& val) {
+        return emplace(key, val);
+    }
+
+    template <class _T>
+    bool remove (const _T& key) {
+        size_t key_hash = hasher{}.hash(key);
+        Shard& shard = _shards[shard_of_hash(key_hash)];
+        std::unique_lock lock(shard.mutex);
+        return shard.map.remove_hashed(key, key_hash) != nullindex;
+    }
+
+    template <class _T>
+    bool contains (const _T& key) const {
+        size_t key_hash = hasher{}.hash(key);
+        const Shard& shard = _shards[shard_of_hash(key_hash)];
+        std::shared_lock lock(shard.mutex);
+        return shard.map.find_hashed(key, key_hash) != nullptr;
+    }
+
+    // copies the value out, since it may change as soon as the shard is unlocked
+    template <class _T>
+    std::optional<value_type> find (const _T& key) const {
+        size_t key_hash = hasher{}.hash(key);
+        const Shard& shard = _shards[shard_of_hash(key_hash)];
+        std::shared_lock lock(shard.mutex);
+        const value_type* val = shard.map.find_hashed(key, key_hash);
+        return val ? std::optional<value_type>(*val) : std::nullopt;
+    }
+
+    // calls fn(const value_type&) under a shared lock, returns false if the key does not exist
+    template <class _T, class _Fn>
+    bool read (const _T& key, _Fn&& fn) const {
+        size_t key_hash = hasher{}.hash(key);
+        const Shard& shard = _shards[shard_of_hash(key_hash)];
+        std::shared_lock lock(shard.mutex);
+        const value_type* val = shard.map.find_hashed(key, key_hash);
+        if (!val) return false;
+        fn(*val);
+        return true;
+    }
+
+    // calls fn(value_type&) under an exclusive lock, returns false if the key does not exist
+    template <class _T, class _Fn>
+    bool update (const _T& key, _Fn&& fn) {
+        size_t key_hash = hasher{}.hash(key);
+        Shard& shard = _shards[shard_of_hash(key_hash)];
+        std::unique_lock lock(shard.mutex);
+        value_type* val = shard.map.find_hashed(key, key_hash);
+        if (!val) return false;
+        fn(*val);
+        return true;
+    }
+
+    // calls fn(map_type&) with the whole shard locked exclusively
+    template <class _Fn>
+    void with_shard (size_type shard_index, _Fn&& fn) {
+        Shard& shard = _shards[shard_index];
+        std::unique_lock lock(shard.mutex);
+        fn(shard.map);
+    }
+
+    // calls fn(const key_type&, const value_type&) for every element of one shard, under a shared lock
+    template <class _Fn>
+    void for_each_shard (size_type shard_index, _Fn&& fn) const {
+        const Shard& shard = _shards[shard_index];
+        std::shared_lock lock(shard.mutex);
+        for (auto [key, val] : shard.map) {
+            fn(key, val);
+        }
+    }
+
+    // visits every shard on up to thread_count threads, fn is called concurrently
+    template <class _Fn>
+    void for_each (_Fn&& fn, size_type thread_count = std::thread::hardware_concurrency()) const {
+        thread_count = std::clamp(thread_count, 1, _ShardCount);
+        std::atomic<size_type> next_shard = 0;
+        auto worker = [&]{
+            for (size_type i = next_shard++; i < _ShardCount; i = next_shard++) {
+                for_each_shard(i, fn);
+            }
+        };
+        Vector<std::thread> threads;
+        for (size_type i = 1; i < thread_count; i++) {
+            threads.emplace_back(worker);
+        }
+        worker();
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    }
+
+    // locks every shard in turn, so this is only a snapshot while writers are running
+    size_type size () const {
+        size_type count = 0;
+        for (const Shard& shard : _shards) {
+            std::shared_lock lock(shard.mutex);
+            count += shard.map.size();
+        }
+        return count;
+    }
+
+private:
+
+    // each shard on its own cache lines, so locking one does not contend with its neighbours
+    struct alignas(64) Shard {
+        mutable std::shared_mutex mutex;
+        map_type map;
+    };
+
+    Array<Shard, _ShardCount> _shards;
+
+};
+
+
+template <
+    class _Key,
+    class _Val,
+    HasherC<_Key> _Hasher = DefaultHasher<_Key>,
+    CompareC<_Key, _Key> _Equal = BasicCmp<_Key>,
+    index_t _ShardCount = 64>
+using ShardedMap = BasicShardedMap<Map<_Key, _Val, _Hasher, _Equal>, _ShardCount>;
+
+
+
+} // namespace luna
@@ -67,6 +67,13 @@ public:
         _sparse[index] = nullindex;
     }
 
+    // takes the first count dense indexes as live, for index chunks that resumed
+    // with the sparse and dense indexes they held, like MmapArrayChunk
+    void resume (size_type count) {
+        ASSERT_IN_RANGE(count, 0, _dense.size());
+        _len = count;
+    }
+
     void reserve (size_type count) {
         _sparse.reserve(count);
         _dense.reserve(count);
@@ -12,12 +12,13 @@ namespace luna {
 
 template <
     ArrayChunk _Chunk,
-    ArrayChunkTypeC<index_t> _IndexChunk>
+    ArrayChunkTypeC<index_t> _IndexChunk,
+    GrowthPolicyC _Growth = DefaultGrowth>
 class BasicSparseVector {
 public:
 
     using value_type = typename _Chunk::value_type;
-    using vector_type = BasicVector<_Chunk>;
+    using vector_type = BasicVector<_Chunk, _Growth>;
     using sparse_set_type = BasicSparseSet<_IndexChunk>;
 
     using size_type = index_t;
@@ -26,6 +27,13 @@ public:
     using iterator = typename vector_type::iterator;
     using const_iterator = typename vector_type::const_iterator;
 
+    // chunks that resume with their elements, like MmapArrayChunk, resume the indexes too
+    BasicSparseVector () {
+        if (_elts.size() > 0) {
+            _sset.resume(_elts.size());
+        }
+    }
+
     index_type push_back (const value_type& val) {
         _elts.push_back(val);
         return _sset.push();
@@ -81,8 +89,8 @@ private:
 };
 
 
-template <class T>
-using SparseVector = BasicSparseVector<HeapArrayChunk<T>, HeapArrayChunk<index_t>>;
+template <class T, GrowthPolicyC _Growth = DefaultGrowth>
+using SparseVector = BasicSparseVector<HeapArrayChunk<T>, HeapArrayChunk<index_t>, _Growth>;
 
 
 } // namespace luna
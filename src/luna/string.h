@@ -18,8 +18,8 @@ public:
 
     BufferString () {}
     BufferString (const char* str) {
-        char* last = std::strncpy(_str, str, buffer_size());
-        _len = last - _str;
+        std::strncpy(_str, str, buffer_size());
+        _len = std::find(_str, _str + buffer_size(), '\0') - _str;
     }
     template <index_t _OLen, class OT>
     BufferString (const BufferString& other) {
@@ -76,7 +76,8 @@ private:
  */
 template <
     ArrayChunk _Chunk,
-    ArrayChunkTypeC<SubArray> _SubArrChunk>
+    ArrayChunkTypeC<SubArray> _SubArrChunk,
+    GrowthPolicyC _Growth = DefaultGrowth>
 class BasicVectorStack {
 public:
 
@@ -138,14 +139,14 @@ public:
 
 private:
 
-    BasicVector<_SubArrChunk> _sub_arrays;
-    BasicVector<_Chunk> _elts;
+    BasicVector<_SubArrChunk, _Growth> _sub_arrays;
+    BasicVector<_Chunk, _Growth> _elts;
 
 };
 
 
-template <class T>
-using VectorStack = BasicVectorStack<HeapArrayChunk<T>, HeapArrayChunk<SubArray>>;
+template <class T, GrowthPolicyC _Growth = DefaultGrowth>
+using VectorStack = BasicVectorStack<HeapArrayChunk<T>, HeapArrayChunk<SubArray>, _Growth>;
 
 
 
@@ -3,17 +3,19 @@
 #include "memory.h"
 #include <memory>
 #include <iterator>
+#include <concepts>
 
 
 namespace luna {
     
 
 
-template <ArrayChunk _Chunk>
+template <ArrayChunk _Chunk, GrowthPolicyC _Growth = DefaultGrowth>
 class BasicVector {
 public:
 
     using chunk_type = PushArrayChunk<_Chunk>;
+    using growth_type = _Growth;
     using value_type = typename chunk_type::value_type;
     using size_type = index_t;
     using index_type = Index<value_type>;
@@ -28,35 +30,57 @@ public:
         resize(count, val);
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherChunk>
-    BasicVector (const BasicVector<_OtherChunk>& other) {
-        reserve(other.capacity());
-        _pool.push_back(other.size());
-        std::uninitialized_copy(other.begin(), other.end(), _pool.begin());
+    template <ArrayChunk _OtherChunk, GrowthPolicyC _OtherGrowth>
+    friend class BasicVector;
+
+    BasicVector (const BasicVector& other) {
+        _copy_from(other);
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherChunk>
-    BasicVector (BasicVector<_OtherChunk>&& other) {
-        reserve(other.capacity());
-        _pool.push_back(other.size());
-        std::uninitialized_move(other.begin(), other.end(), _pool.begin());
-        other._pool.deallocate();
+    template <ArrayChunkTypeC<value_type> _OtherChunk, class _OtherGrowth>
+    BasicVector (const BasicVector<_OtherChunk, _OtherGrowth>& other) {
+        _copy_from(other);
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherChunk>
-    BasicVector& operator= (const BasicVector<_OtherChunk>& other) {
-        reserve(other.capacity());
-        _pool.push_back(other.size());
-        std::uninitialized_copy(other.begin(), other.end(), _pool.begin());
+    // takes over the memory of other when the chunk can be relocated, else its elements one by one
+    BasicVector (BasicVector&& other) {
+        _move_from(std::move(other));
+    }
+
+    template <ArrayChunkTypeC<value_type> _OtherChunk, class _OtherGrowth>
+    BasicVector (BasicVector<_OtherChunk, _OtherGrowth>&& other) {
+        _move_from(std::move(other));
+    }
+
+    BasicVector& operator= (const BasicVector& other) {
+        if (this != &other) {
+            clear();
+            _copy_from(other);
+        }
         return *this;
     }
 
-    template <ArrayChunkTypeC<value_type> _OtherChunk>
-    BasicVector& operator= (BasicVector<_OtherChunk>&& other) {
-        reserve(other.capacity());
-        _pool.push_back(other.size());
-        std::uninitialized_move(other.begin(), other.end(), _pool.begin());
-        other._pool.deallocate();
+    template <ArrayChunkTypeC<value_type> _OtherChunk, class _OtherGrowth>
+    BasicVector& operator= (const BasicVector<_OtherChunk, _OtherGrowth>& other) {
+        clear();
+        _copy_from(other);
+        return *this;
+    }
+
+    BasicVector& operator= (BasicVector&& other) {
+        if (this != &other) {
+            clear();
+            _pool.deallocate();
+            _move_from(std::move(other));
+        }
+        return *this;
+    }
+
+    template <ArrayChunkTypeC<value_type> _OtherChunk, class _OtherGrowth>
+    BasicVector& operator= (BasicVector<_OtherChunk, _OtherGrowth>&& other) {
+        clear();
+        _pool.deallocate();
+        _move_from(std::move(other));
         return *this;
     }
 
@@ -74,7 +98,7 @@ public:
     template <class... _Args>
     value_type& emplace_back (_Args&&... args) {
         if (_pool.is_full()) {
-            reserve(std::max(size() * 2, 1));
+            reserve(_Growth::grow(capacity(), sizeof(value_type)));
         }
         value_type* ptr = _pool.push_back();
         _pool.construct(ptr, std::forward<_Args>(args)...);
@@ -88,14 +112,13 @@ public:
     template <class... _Args>
     value_type& emplace (size_type index, _Args&&... args) {
         if (_pool.is_full()) {
-            reserve(std::max(size() * 2, 1));
-        }
-        _pool.push_back();
-        for (size_type i = size() - 1; i-- > index;) {
-            _pool.construct(i + 1, std::move(_pool.at(i)));
+            reserve(_Growth::grow(capacity(), sizeof(value_type)));
         }
-        _pool.construct(index, std::forward<_Args>(args)...);
-        return _pool.at(index);
+        value_type* last = _pool.push_back();
+        value_type* ptr = _pool.begin() + index;
+        relocate_backward(ptr, last, last + 1);
+        _pool.construct(ptr, std::forward<_Args>(args)...);
+        return *ptr;
     }
     void insert (size_type index, const value_type& val) {
         emplace(index, val);
@@ -109,8 +132,7 @@ public:
             _pool.set_size(count);
         } else if (count > size()) {
             reserve(count);
-            value_type* prev_end = _pool.end();
-            _pool.set_full();
+            value_type* prev_end = _pool.push_back(count - size());
             std::uninitialized_fill(prev_end, _pool.end(), val);
         }
     }
@@ -119,6 +141,11 @@ public:
         _pool.reserve_move(count);
     }
 
+    // releases the capacity past the last element
+    void shrink_to_fit () {
+        _pool.shrink_move();
+    }
+
     void pop_back () {
         _pool.destroy(_pool.pop_back());
     }
@@ -176,20 +203,42 @@ private:
     void _remove_move (index_type index, size_type remove_count, size_type move_count) {
         ASSERT_IN_RANGE((size_type)index + remove_count, 0, size());
         for (index_type i = index; i < index + remove_count; i++) {
-            _pool.destroy(index);
-        }
-        for (size_type i = 0; i < move_count; i++) {
-            _pool.construct(index + i, std::move(_pool.at(size() - move_count + i)));
+            _pool.destroy(i);
         }
+        relocate(_pool.end() - move_count, _pool.end(), _pool.begin() + index);
         _pool.pop_back(remove_count);
     }
 
+    template <ArrayChunkTypeC<value_type> _OtherChunk, class _OtherGrowth>
+    void _copy_from (const BasicVector<_OtherChunk, _OtherGrowth>& other) {
+        reserve(other.size());
+        _pool.push_back(other.size());
+        std::uninitialized_copy(other.begin(), other.end(), _pool.begin());
+    }
+
+    // expects this to be empty, and leaves other empty
+    template <ArrayChunkTypeC<value_type> _OtherChunk, class _OtherGrowth>
+    void _move_from (BasicVector<_OtherChunk, _OtherGrowth>&& other) {
+        if constexpr (std::same_as<_OtherChunk, _Chunk> && is_trivially_relocatable_v<chunk_type>) {
+            std::swap(_pool, other._pool);
+        } else {
+            reserve(other.size());
+            _pool.push_back(other.size());
+            relocate(other.begin(), other.end(), _pool.begin());
+            other._pool.clear();
+            other._pool.deallocate();
+        }
+    }
+
     chunk_type _pool;
 
 };
 
-template <class T, class _Alloc = std::allocator<T>>
-using Vector = BasicVector<HeapArrayChunk<T, _Alloc>>;
+template <ArrayChunk _Chunk, GrowthPolicyC _Growth>
+struct is_trivially_relocatable<BasicVector<_Chunk, _Growth>> : is_trivially_relocatable<PushArrayChunk<_Chunk>> {};
+
+template <class T, class _Alloc = std::allocator<T>, GrowthPolicyC _Growth = DefaultGrowth>
+using Vector = BasicVector<HeapArrayChunk<T, _Alloc>, _Growth>;
 
 template <class T, index_t _Len>
 using InplaceVector = BasicVector<InplaceArrayChunk<T, _Len>>;
@@ -7,7 +7,28 @@
 #include "luna/map.h"
 #include "benchmark.h"
 #include "luna/vector-stack.h"
+#include "luna/sharded-map.h"
+#include "luna/read-mostly-map.h"
+#include "luna/set-algebra.h"
+#include "luna/frozen.h"
+#include "luna/btree.h"
+#include "luna/multi-map.h"
+#include "luna/pool.h"
+#include "luna/arena.h"
+#include "luna/page-memory.h"
+#include "luna/mmap-chunk.h"
+#include <map>
+#include <filesystem>
+#include <cstdio>
 #include <unordered_map>
+#include <random>
+#include <thread>
+#include <mutex>
+#ifdef LUNA_MMAP
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
 
 
 using namespace luna;
@@ -237,6 +258,1432 @@ void test_map () {
 }
 
 
+// finds in a Map and a Map with a Bloom filter holding the same keys, with an increasing share of the lookups missing
+void test_bloom_map () {
+    Map<int, int> map1;
+    BasicMap<HeapArrayChunk<int>, HeapArrayChunk<int>, HeapArrayChunk<index_t>,
+        BasicHasher<int>, BasicCmp<int>, BloomBucketVector> map2;
+
+    int count = 10000000;
+
+    Vector<int> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x7fffffff);
+        map1.insert(keys.back(), i);
+        map2.insert(keys.back(), i);
+    }
+
+    long n1 = 0;
+    long n2 = 0;
+    Vector<int> lookups(count);
+
+    for (int miss_percent : { 0, 50, 90, 99 }) {
+        for (int i = 0; i < count; i++) {
+            lookups[i] = (int)(rng() % 100) < miss_percent ? (int)(rng() & 0x7fffffff) : keys[rng() % count];
+        }
+        std::cout << miss_percent << "% misses\n";
+        log_time_action([&]{
+            for (int key : lookups) {
+                int* val = map1.find(key);
+                n1 += val ? *val : 0;
+            }
+        });
+        log_time_action([&]{
+            for (int key : lookups) {
+                int* val = map2.find(key);
+                n2 += val ? *val : 0;
+            }
+        });
+        std::cout << "\n";
+    }
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+
+void test_probe_map () {
+    Map<int, int> map1;
+    ProbeMap<int, int> map2;
+
+    int count = 10000000;
+
+    Vector<int> keys;
+    Vector<int> miss_keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x7fffffff);
+        miss_keys.push_back(rng() & 0x7fffffff);
+    }
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            map1.insert(keys[i], i);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            map2.insert(keys[i], i);
+        }
+    });
+    std::cout << "\n";
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n1 += *map1.find(keys[i]);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n2 += *map2.find(keys[i]);
+        }
+    });
+    std::cout << "\n";
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n1 += map1.find(miss_keys[i]) != nullptr;
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n2 += map2.find(miss_keys[i]) != nullptr;
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+
+void test_hashed_set () {
+    Set<std::string> set1;
+    HashedSet<std::string> set2;
+
+    int count = 3000000;
+
+    Vector<std::string> keys;
+    for (int i = 0; i < count; i++) {
+        keys.push_back("some/longish/key/prefix/" + std::to_string(i));
+    }
+
+    log_time_action([&]{
+        for (const std::string& key : keys) {
+            set1.insert(key);
+        }
+    });
+    log_time_action([&]{
+        for (const std::string& key : keys) {
+            set2.insert(key);
+        }
+    });
+    std::cout << "\n";
+
+    int n1 = 0;
+    int n2 = 0;
+
+    log_time_action([&]{
+        for (const std::string& key : keys) {
+            n1 += set1.find(key) != nullptr;
+        }
+    });
+    log_time_action([&]{
+        for (const std::string& key : keys) {
+            n2 += set2.find(key) != nullptr;
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+
+template <BucketReduceC _Reduce, class T>
+void time_bucket_reduce (const char* name, const Vector<T>& keys) {
+    using set_type = BasicSet<
+        HeapArrayChunk<T>,
+        HeapArrayChunk<index_t>,
+        BasicHasher<T>,
+        BasicCmp<T>,
+        BasicBucketVector<HeapArrayChunk<index_t>, false, _Reduce>>;
+    set_type set;
+    int n = 0;
+
+    std::cout << name << "\n";
+    log_time_action([&]{
+        for (const T& key : keys) {
+            set.insert(key);
+        }
+    });
+    log_time_action([&]{
+        for (const T& key : keys) {
+            n += set.find(key) != nullptr;
+        }
+    });
+    std::cout << n << "\n\n";
+}
+
+
+void test_bucket_reduce () {
+    int count = 2000000;
+
+    // strided keys collide badly when only their low bits are kept
+    Vector<int> int_keys;
+    for (int i = 0; i < count; i++) {
+        int_keys.push_back(i * 64);
+    }
+    time_bucket_reduce<ModuloReduce>("modulo int", int_keys);
+    time_bucket_reduce<FibonacciReduce>("fibonacci int", int_keys);
+    time_bucket_reduce<PrimeReduce>("prime int", int_keys);
+
+    Vector<std::string> string_keys;
+    for (int i = 0; i < count; i++) {
+        string_keys.push_back("key/" + std::to_string(i));
+    }
+    time_bucket_reduce<ModuloReduce>("modulo string", string_keys);
+    time_bucket_reduce<FibonacciReduce>("fibonacci string", string_keys);
+    time_bucket_reduce<MaskReduce>("mask string", string_keys);
+    time_bucket_reduce<PrimeReduce>("prime string", string_keys);
+}
+
+
+// inserts keys into a set using _Hasher, printing how evenly they spread over the buckets and how long it takes
+template <class _Hasher, class T>
+void time_hasher (const char* name, const Vector<T>& keys) {
+    Set<T, _Hasher> set;
+    int n = 0;
+
+    std::cout << name << "\n";
+    log_time_action([&]{
+        for (const T& key : keys) {
+            set.insert(key);
+        }
+    });
+    log_time_action([&]{
+        for (const T& key : keys) {
+            n += set.find(key) != nullptr;
+        }
+    });
+
+    // sets reduce hashes with ModuloReduce by default
+    Vector<int> lengths(set.bucket_count(), 0);
+    for (const T& key : keys) {
+        lengths[_Hasher{}.hash(key) % set.bucket_count()]++;
+    }
+    int used = 0;
+    int longest = 0;
+    long walked = 0;
+    for (int length : lengths) {
+        used += length > 0;
+        longest = std::max(longest, length);
+        walked += (long)length * (length + 1) / 2;
+    }
+    std::cout << "buckets used " << used << "/" << set.bucket_count()
+        << ", longest chain " << longest
+        << ", average elements walked per hit " << (double)walked / keys.size() << "\n";
+    std::cout << n << "\n\n";
+}
+
+
+template <class _Hasher>
+void time_string_hash (const char* name, const Vector<std::string>& strings, int rounds) {
+    size_t n = 0;
+    std::cout << name << "\n";
+    log_time_action([&]{
+        for (int r = 0; r < rounds; r++) {
+            for (const std::string& str : strings) {
+                n += _Hasher{}.hash(str);
+            }
+        }
+    });
+    std::cout << (n & 1) << "\n";
+}
+
+
+struct StdStringHasher {
+    static size_t hash (std::string_view str) {
+        return std::hash<std::string_view>{}(str);
+    }
+};
+
+
+void test_fast_hasher () {
+    int count = 2000000;
+
+    // sequential keys are spread perfectly even by the identity hash
+    Vector<int> sequential_keys;
+    // what is left of test_map after removing every other key
+    Vector<int> odd_keys;
+    Vector<int> strided_keys;
+    for (int i = 0; i < count; i++) {
+        sequential_keys.push_back(i);
+        odd_keys.push_back(i * 2 + 1);
+        strided_keys.push_back(i * 64);
+    }
+    time_hasher<BasicHasher<int>>("basic sequential", sequential_keys);
+    time_hasher<FastHasher<int>>("fast sequential", sequential_keys);
+    time_hasher<BasicHasher<int>>("basic odd", odd_keys);
+    time_hasher<FastHasher<int>>("fast odd", odd_keys);
+    time_hasher<BasicHasher<int>>("basic strided", strided_keys);
+    time_hasher<FastHasher<int>>("fast strided", strided_keys);
+
+    Vector<std::string> string_keys;
+    for (int i = 0; i < count; i++) {
+        string_keys.push_back("key/" + std::to_string(i));
+    }
+    time_hasher<BasicHasher<std::string>>("basic string", string_keys);
+    time_hasher<FastHasher<std::string>>("fast string", string_keys);
+
+    // string keys are found from string_views, without building a string
+    FastMap<std::string, int> names;
+    names.insert(string_keys[0], 0);
+    std::string_view name = string_keys[0];
+    assert(names.find(name) && *names.find(name) == 0);
+    assert(!names.find(std::string_view("key/")));
+
+    // raw hashing throughput, over the same number of bytes for every length
+    for (int length : { 8, 32, 200, 4096 }) {
+        Vector<std::string> strings;
+        for (int i = 0; i < 64; i++) {
+            strings.push_back(std::string(length, (char)('a' + i % 26)));
+        }
+        int rounds = (1 << 30) / (length * 64);
+        std::cout << length << " bytes\n";
+        time_string_hash<StdStringHasher>("std::hash", strings, rounds);
+        time_string_hash<FastHasher<std::string>>("fast", strings, rounds);
+        std::cout << "\n";
+    }
+}
+
+
+template <class _Map>
+void time_worst_insert (_Map& map, int count) {
+    double worst = 0;
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            worst = std::max(worst, time_action([&]{
+                map.insert(i * 2654435761u, i);
+            }));
+        }
+    });
+    std::cout << "worst insert " << worst << "ms\n";
+}
+
+
+void test_incremental_map () {
+    Map<unsigned, int> map1;
+    IncrementalMap<unsigned, int> map2;
+
+    int count = 20000000;
+
+    time_worst_insert(map1, count);
+    time_worst_insert(map2, count);
+}
+
+
+// each thread does count operations, 1 in 8 being an insert
+template <class _Insert, class _Find>
+double time_threads (int thread_count, int count, _Insert&& insert, _Find&& find) {
+    return time_action([&]{
+        Vector<std::thread> threads;
+        for (int t = 0; t < thread_count; t++) {
+            threads.emplace_back([&, t]{
+                std::mt19937 rng(t);
+                for (int i = 0; i < count; i++) {
+                    int key = rng() % 1000000;
+                    if (i % 8 == 0) {
+                        insert(key);
+                    } else {
+                        find(key);
+                    }
+                }
+            });
+        }
+        for (std::thread& thread : threads) {
+            thread.join();
+        }
+    });
+}
+
+
+void test_sharded_map () {
+    int count = 2000000;
+    int max_threads = std::thread::hardware_concurrency();
+
+    for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        Map<int, int> map1;
+        std::mutex mutex;
+        ShardedMap<int, int> map2;
+        std::atomic<int> n1 = 0;
+        std::atomic<int> n2 = 0;
+
+        double t1 = time_threads(thread_count, count,
+            [&](int key) {
+                std::lock_guard lock(mutex);
+                map1.insert(key, key);
+            },
+            [&](int key) {
+                std::lock_guard lock(mutex);
+                n1 += map1.find(key) != nullptr;
+            }
+        );
+        double t2 = time_threads(thread_count, count,
+            [&](int key) { map2.insert(key, key); },
+            [&](int key) { n2 += map2.contains(key); }
+        );
+        std::cout << thread_count << " threads: " << t1 << "ms " << t2 << "ms\n";
+    }
+
+    ShardedMap<int, int> map;
+    for (int i = 0; i < count; i++) {
+        map.insert(i, i);
+    }
+    std::atomic<long> sum = 0;
+    log_time_action([&]{
+        map.for_each([&](int, int val) {
+            sum += val;
+        });
+    });
+    std::cout << sum << "\n";
+}
+
+
+// readers look up random keys while one writer keeps replacing values
+void test_read_mostly_map () {
+    int count = 1000000;
+    int lookups = 4000000;
+    int max_threads = std::thread::hardware_concurrency();
+
+    ShardedMap<int, int> sharded;
+    ReadMostlyMap<int, int> read_mostly;
+    for (int i = 0; i < count; i++) {
+        sharded.insert(i, i);
+        read_mostly.insert(i, i);
+    }
+
+    auto time_readers = [&](int thread_count, auto&& writer, auto&& reader) {
+        std::atomic<bool> done = false;
+        std::thread writer_thread([&]{
+            std::mt19937 rng(100);
+            while (!done) {
+                int key = rng() % count;
+                writer(key);
+                std::this_thread::yield();
+            }
+        });
+        double t = time_action([&]{
+            Vector<std::thread> threads;
+            for (int t = 0; t < thread_count; t++) {
+                threads.emplace_back([&, t]{
+                    reader(t);
+                });
+            }
+            for (std::thread& thread : threads) {
+                thread.join();
+            }
+        });
+        done = true;
+        writer_thread.join();
+        return t;
+    };
+
+    for (int thread_count = 1; thread_count <= max_threads; thread_count *= 2) {
+        std::atomic<long> n1 = 0;
+        std::atomic<long> n2 = 0;
+        double t1 = time_readers(thread_count,
+            [&](int key) { sharded.update(key, [](int& val) { val++; }); },
+            [&](int t) {
+                std::mt19937 rng(t);
+                long n = 0;
+                for (int i = 0; i < lookups; i++) {
+                    n += sharded.contains(rng() % count);
+                }
+                n1 += n;
+            }
+        );
+        double t2 = time_readers(thread_count,
+            [&](int key) { read_mostly.insert_or_assign(key, key + 1); },
+            [&](int t) {
+                auto reader = read_mostly.reader();
+                std::mt19937 rng(t);
+                long n = 0;
+                for (int i = 0; i < lookups; i++) {
+                    n += reader.contains(rng() % count);
+                }
+                n2 += n;
+            }
+        );
+        std::cout << thread_count << " threads: " << t1 << "ms " << t2 << "ms " << n1 << " " << n2 << "\n";
+    }
+}
+
+
+void test_batch_find () {
+    Map<int, int> map1;
+    ProbeMap<int, int> map2;
+
+    int count = 10000000;
+    int batch_size = 256;
+
+    Vector<int> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x7fffffff);
+        map1.insert(keys.back(), i);
+        map2.insert(keys.back(), i);
+    }
+    // half of the lookups miss
+    for (int i = 0; i < count; i += 2) {
+        keys[i] = rng() & 0x7fffffff;
+    }
+
+    long n1 = 0;
+    long n2 = 0;
+    Vector<int*> out(batch_size);
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            int* val = map1.find(keys[i]);
+            n1 += val ? *val : 0;
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i += batch_size) {
+            int size = std::min(batch_size, count - i);
+            map1.find_batch(Span<const int>(keys.data() + i, size), Span<int*>(out.data(), size));
+            for (int j = 0; j < size; j++) {
+                n2 += out[j] ? *out[j] : 0;
+            }
+        }
+    });
+    std::cout << "\n";
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            int* val = map2.find(keys[i]);
+            n1 += val ? *val : 0;
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i += batch_size) {
+            int size = std::min(batch_size, count - i);
+            map2.find_batch(Span<const int>(keys.data() + i, size), Span<int*>(out.data(), size));
+            for (int j = 0; j < size; j++) {
+                n2 += out[j] ? *out[j] : 0;
+            }
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+
+void test_hashed_lookup () {
+    Map<std::string, int> from1, from2;
+    Map<std::string, int> to1, to2;
+
+    int count = 1000000;
+
+    Vector<std::string> keys;
+    for (int i = 0; i < count; i++) {
+        keys.push_back("some/longish/key/prefix/" + std::to_string(i));
+        from1.insert(keys.back(), i);
+        from2.insert(keys.back(), i);
+    }
+
+    // moves every other key across, hashing each key once per table or once in total
+    log_time_action([&]{
+        for (int i = 0; i < count; i += 2) {
+            const std::string& key = keys[i];
+            if (int* val = from1.find(key)) {
+                to1.insert(key, *val);
+                from1.remove(key);
+            }
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i += 2) {
+            const std::string& key = keys[i];
+            size_t hash = from2.hash_of(key);
+            if (int* val = from2.find_hashed(key, hash)) {
+                to2.insert_hashed(key, hash, *val);
+                from2.remove_hashed(key, hash);
+            }
+        }
+    });
+    std::cout << "\n";
+
+    for (int i = 0; i < count; i++) {
+        bool moved = i % 2 == 0;
+        assert((from2.find(keys[i]) == nullptr) == moved);
+        assert((to2.find(keys[i]) != nullptr) == moved);
+    }
+    std::cout << to1.size() << " " << to2.size() << " " << from2.size() << "\n";
+}
+
+void test_set_algebra () {
+    Set<int> small;
+    Set<int> large;
+
+    std::mt19937 rng(1);
+    for (int i = 0; i < 1000000; i++) {
+        small.insert(rng() & 0xffffff);
+    }
+    for (int i = 0; i < 8000000; i++) {
+        large.insert(rng() & 0xffffff);
+    }
+
+    Set<int> out1, out2, out3;
+
+    log_time_action([&]{
+        for (int val : small) {
+            if (large.find(val)) {
+                out1.insert(val);
+            }
+        }
+    });
+    log_time_action([&]{
+        set_intersection(large, small, out2);
+    });
+    log_time_action([&]{
+        set_intersection(large, small, out3, std::thread::hardware_concurrency());
+    });
+    std::cout << "\n";
+
+    Set<int> uni = set_union(small, large);
+    Set<int> diff = set_difference(small, large);
+    assert(uni.size() + out2.size() == small.size() + large.size());
+    assert(diff.size() + out2.size() == small.size());
+
+    long joined = 0;
+    Map<int, int> map1;
+    ProbeMap<int, int> map2;
+    for (int i = 0; i < 100000; i++) {
+        map1.insert(i * 2, i);
+        map2.insert(i * 3, i);
+    }
+    map_join(map1, map2, [&](int key, int a, int b) {
+        assert(key == a * 2 && key == b * 3);
+        joined++;
+    });
+
+    std::cout << out1.size() << " " << out2.size() << " " << out3.size() << " " << joined << "\n";
+}
+
+void test_compact () {
+    Map<int, StupidlyBigObject> map;
+
+    int count = 10000000;
+
+    for (int i = 0; i < count; i++) {
+        map.insert(i, StupidlyBigObject{ {i} });
+    }
+    for (int i = 0; i < count; i++) {
+        if (i % 4 != 0) {
+            map.remove(i);
+        }
+    }
+
+    long n1 = 0;
+    long n2 = 0;
+
+    // copies own their storage, so compacting the map leaves this one as it was
+    Map<int, StupidlyBigObject> copy = map;
+
+    log_time_action([&]{
+        for (auto [key, val] : map) {
+            n1 += val.n[0];
+        }
+    });
+    log_time_action([&]{
+        map.compact([&](auto old_index, auto new_index) {
+            assert(new_index <= old_index);
+        });
+    });
+    log_time_action([&]{
+        for (auto [key, val] : map) {
+            n2 += val.n[0];
+        }
+    });
+    std::cout << "\n";
+
+    for (int i = 0; i < count; i += 4) {
+        assert(map.at(i).n[0] == i);
+    }
+    Map<int, StupidlyBigObject> moved = std::move(copy);
+    assert(moved.size() == map.size() && moved.keys().full_size() > map.keys().full_size());
+    for (auto [key, val] : moved) {
+        assert(map.at(key).n[0] == val.n[0]);
+    }
+    std::cout << n1 << " " << n2 << " " << map.size() << "\n";
+}
+
+void test_parallel_build () {
+    int count = 20000000;
+
+    Vector<int> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x7fffffff);
+    }
+
+    Set<int> set1;
+    Set<int> set2;
+    ProbeSet<int> set3;
+
+    log_time_action([&]{
+        for (int key : keys) {
+            set1.insert(key);
+        }
+    });
+    log_time_action([&]{
+        set2.build_from(keys, ParallelPolicy{});
+    });
+    log_time_action([&]{
+        set3.build_from(keys, ParallelPolicy{});
+    });
+    std::cout << "\n";
+
+    log_time_action([&]{
+        set1.rehash(set1.bucket_count() * 2);
+    });
+    log_time_action([&]{
+        set2.rehash(set2.bucket_count() * 2, ParallelPolicy{});
+    });
+    std::cout << "\n";
+
+    std::cout << set1.size() << " " << set2.size() << " " << set3.size() << "\n";
+}
+
+void test_upsert () {
+    Map<std::string, int> map1;
+    Map<std::string, int> map2;
+
+    int count = 5000000;
+
+    Vector<std::string> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back("key/" + std::to_string(rng() % 100000));
+    }
+
+    // counting with a lookup and then an insert for new keys, against a single lookup
+    log_time_action([&]{
+        for (const std::string& key : keys) {
+            if (int* n = map1.find(key)) {
+                (*n)++;
+            } else {
+                map1.insert(key, 1);
+            }
+        }
+    });
+    log_time_action([&]{
+        for (const std::string& key : keys) {
+            map2.find_or_emplace_with(key, []{ return 0; })++;
+        }
+    });
+    std::cout << "\n";
+
+    for (auto [key, n] : map1) {
+        assert(map2.at(key) == n);
+    }
+    map2.insert_or_assign(keys[0], -1);
+    assert(map2.at(keys[0]) == -1);
+    std::cout << map1.size() << " " << map2.size() << "\n";
+}
+
+struct Payload {
+    int n[6];
+};
+
+template <class _Map>
+void time_map_layout (const Vector<int>& keys) {
+    _Map map;
+    for (int i = 0; i < keys.size(); i++) {
+        map.insert(keys[i], Payload{ {i} });
+    }
+
+    long n = 0;
+    // random lookups reading the value
+    log_time_action([&]{
+        for (int key : keys) {
+            n += map.at(key).n[0];
+        }
+    });
+    // a scan reading only keys
+    log_time_action([&]{
+        for (const auto& key : map.keys()) {
+            n += entry_key(key) & 1;
+        }
+    });
+    // a scan reading keys and values
+    log_time_action([&]{
+        for (auto [key, val] : map) {
+            n += val.n[0];
+        }
+    });
+    std::cout << n << "\n";
+}
+
+void test_map_layout () {
+    int count = 10000000;
+
+    Vector<int> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x7fffffff);
+    }
+
+    time_map_layout<Map<int, Payload>>(keys);
+    time_map_layout<InterleavedMap<int, Payload>>(keys);
+    // entries go in the kind of chunk the keys and values were given, here on huge pages
+    time_map_layout<BasicMap<
+        HugePageHeapArrayChunk<int>,
+        HugePageHeapArrayChunk<Payload>,
+        HeapArrayChunk<index_t>,
+        DefaultHasher<int>,
+        BasicCmp<int>,
+        BucketVector,
+        MapLayout::interleaved>>(keys);
+}
+
+void test_frozen_map () {
+    Map<int, int> map;
+
+    int count = 10000000;
+
+    Vector<int> keys;
+    Vector<int> miss_keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x7fffffff);
+        miss_keys.push_back(rng() & 0x7fffffff);
+        map.insert(keys.back(), i);
+    }
+
+    FrozenMap<int, int> frozen;
+    log_time_action([&]{
+        frozen.build(map);
+    });
+    std::cout << "frozen bytes per key " << (double)frozen.byte_size() / frozen.size() << "\n\n";
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n1 += *map.find(keys[i]);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n2 += *frozen.find(keys[i]);
+        }
+    });
+    std::cout << "\n";
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n1 += map.find(miss_keys[i]) != nullptr;
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n2 += frozen.find(miss_keys[i]) != nullptr;
+        }
+    });
+    std::cout << "\n";
+
+    // the same lookups through a view of a flat buffer, as if it had been read from disk
+    Vector<uint64_t> buffer(frozen.byte_size() / sizeof(uint64_t) + 1);
+    frozen.write_to(buffer.data());
+    auto view = FrozenMapView<int, int>::from_buffer(buffer.data());
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n2 -= *view.find(keys[i]);
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+
+void test_btree_map () {
+    std::map<int, int> std_map;
+    BTreeMap<int, int> btree;
+
+    int count = 2000000;
+
+    Vector<int> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() & 0x3fffffff);
+    }
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            std_map.emplace(keys[i], i);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            btree.emplace(keys[i], i);
+        }
+    });
+    std::cout << "\n";
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n1 += std_map.find(keys[i])->second;
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            n2 += *btree.find(keys[i]);
+        }
+    });
+    std::cout << "\n";
+
+    // full ordered scans
+    log_time_action([&]{
+        for (int r = 0; r < 10; r++) {
+            for (auto& [key, val] : std_map) {
+                n1 += val;
+            }
+        }
+    });
+    log_time_action([&]{
+        for (int r = 0; r < 10; r++) {
+            for (auto [key, val] : btree) {
+                n2 += val;
+            }
+        }
+    });
+    std::cout << "\n";
+
+    // short range scans, about 100 elements each
+    int width = 0x3fffffff / count * 100;
+    log_time_action([&]{
+        for (int i = 0; i < count / 10; i++) {
+            auto last = std_map.lower_bound(keys[i] + width);
+            for (auto it = std_map.lower_bound(keys[i]); it != last; ++it) {
+                n1 += it->second;
+            }
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count / 10; i++) {
+            for (auto [key, val] : btree.range(keys[i], keys[i] + width)) {
+                n2 += val;
+            }
+        }
+    });
+    std::cout << "\n";
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i += 2) {
+            std_map.erase(keys[i]);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i += 2) {
+            btree.remove(keys[i]);
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << " " << std_map.size() << " " << btree.size() << "\n";
+}
+
+void test_multi_map () {
+    Map<int, Vector<int>> vector_map;
+    std::unordered_multimap<int, int> std_map;
+    MultiMap<int, int> multi_map;
+
+    // about 5 values per key
+    int count = 2000000;
+    int key_count = count / 5;
+
+    Vector<int> keys;
+    std::mt19937 rng(1);
+    for (int i = 0; i < count; i++) {
+        keys.push_back(rng() % key_count);
+    }
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            vector_map[keys[i]].push_back(i);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            std_map.emplace(keys[i], i);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            multi_map.insert(keys[i], i);
+        }
+    });
+    std::cout << "\n";
+
+    long n1 = 0;
+    long n2 = 0;
+    long n3 = 0;
+
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            for (int val : *vector_map.find(keys[i])) {
+                n1 += val;
+            }
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            auto [first, last] = std_map.equal_range(keys[i]);
+            for (; first != last; ++first) {
+                n2 += first->second;
+            }
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < count; i++) {
+            for (int val : multi_map.values_of(keys[i])) {
+                n3 += val;
+            }
+        }
+    });
+    std::cout << "\n";
+
+    log_time_action([&]{
+        for (int i = 0; i < key_count; i += 2) {
+            vector_map.remove(i);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < key_count; i += 2) {
+            std_map.erase(i);
+        }
+    });
+    log_time_action([&]{
+        for (int i = 0; i < key_count; i += 2) {
+            multi_map.remove(i);
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << " " << n3 << " " << std_map.size() << " " << multi_map.size() << "\n";
+}
+
+// many short lived requests, each building a few small containers and dropping them
+void test_arena () {
+    int requests = 20000;
+    int count = 1000;
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        for (int r = 0; r < requests; r++) {
+            Map<int, int> map;
+            Vector<int> vec;
+            for (int i = 0; i < count; i++) {
+                map.insert(i * 7 + r, i);
+                vec.push_back(i);
+            }
+            n1 += map.size() + vec.size();
+        }
+    });
+
+    MonotonicBuffer buffer;
+    log_time_action([&]{
+        for (int r = 0; r < requests; r++) {
+            {
+                ArenaScope scope(buffer);
+                ArenaMap<int, int> map;
+                ArenaVector<int> vec;
+                for (int i = 0; i < count; i++) {
+                    map.insert(i * 7 + r, i);
+                    vec.push_back(i);
+                }
+                n2 += map.size() + vec.size();
+            }
+            buffer.reset();
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+// std::allocator, counting the calls to allocate
+template <class T>
+struct CountingAllocator {
+    using value_type = T;
+
+    static inline long allocations = 0;
+
+    CountingAllocator () = default;
+    template <class U>
+    CountingAllocator (const CountingAllocator<U>&) {}
+
+    T* allocate (size_t count) {
+        allocations++;
+        return std::allocator<T>().allocate(count);
+    }
+    void deallocate (T* ptr, size_t count) {
+        std::allocator<T>().deallocate(ptr, count);
+    }
+
+    template <class U>
+    bool operator== (const CountingAllocator<U>&) const { return true; }
+};
+
+// millions of tiny vectors, as when every object embeds one
+void test_pool_allocator () {
+    int count = 2000000;
+
+    auto build = [&](auto& vectors) {
+        for (int i = 0; i < count; i++) {
+            vectors.emplace_back();
+            for (int j = 0; j < i % 8 + 1; j++) {
+                vectors.back().push_back(j);
+            }
+        }
+    };
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        Vector<Vector<int, CountingAllocator<int>>> vectors;
+        vectors.reserve(count);
+        build(vectors);
+        for (const auto& vec : vectors) {
+            n1 += vec.size();
+        }
+    });
+    size_t slabs = PoolAllocator<int>::slab_count();
+    log_time_action([&]{
+        Vector<Vector<int, PoolAllocator<int>>> vectors;
+        vectors.reserve(count);
+        build(vectors);
+        for (const auto& vec : vectors) {
+            n2 += vec.size();
+        }
+    });
+    std::cout << "\n";
+
+    std::cout << "std::allocator calls " << CountingAllocator<int>::allocations
+        << ", pool slabs " << PoolAllocator<int>::slab_count() - slabs << "\n";
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+// random reads over arrays far larger than what 4KB pages let the TLB cover
+void test_huge_pages () {
+    int count = 1 << 26;
+    int reads = 20000000;
+
+    AlignedVector<float> aligned;
+    aligned.resize(100);
+    assert((uintptr_t)aligned.data() % 64 == 0);
+
+    auto gather = [&](const auto& vec) {
+        uint32_t x = 12345;
+        long sum = 0;
+        for (int i = 0; i < reads; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            sum += vec[x & (count - 1)];
+        }
+        return sum;
+    };
+
+    long n1 = 0;
+    long n2 = 0;
+
+    Vector<int> vec;
+    HugePageVector<int> huge;
+    vec.resize(count);
+    huge.resize(count);
+    assert((uintptr_t)huge.data() % huge_page_size == 0);
+    for (int i = 0; i < count; i++) {
+        vec[i] = i;
+        huge[i] = i;
+    }
+    log_time_action([&]{ n1 += gather(vec); });
+    log_time_action([&]{ n2 += gather(huge); });
+    std::cout << "\n";
+
+    int keys = 1 << 23;
+    Map<int, int> map;
+    HugePageMap<int, int> huge_map;
+    for (int i = 0; i < keys; i++) {
+        map.insert(i * 7, i);
+        huge_map.insert(i * 7, i);
+    }
+    auto lookup = [&](const auto& m) {
+        uint32_t x = 12345;
+        long sum = 0;
+        for (int i = 0; i < reads; i++) {
+            x ^= x << 13;
+            x ^= x >> 17;
+            x ^= x << 5;
+            sum += *m.find((int)(x & (keys - 1)) * 7);
+        }
+        return sum;
+    };
+    log_time_action([&]{ n1 += lookup(map); });
+    log_time_action([&]{ n2 += lookup(huge_map); });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+// growing a vector of hundreds of MB, where a fresh block and a copy per doubling add up
+void test_realloc_growth () {
+    int count = 100000000;
+
+    // 0 where getrusage is not available
+    auto peak_mb = []{
+#ifdef LUNA_MMAP
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return (long)usage.ru_maxrss / 1024;
+#else
+        return 0L;
+#endif
+    };
+
+    long n1 = 0;
+    long n2 = 0;
+
+    // the peak only ever grows, so the allocator expected to need less goes first
+    log_time_action([&]{
+        ReallocVector<int> vec;
+        for (int i = 0; i < count; i++) {
+            vec.push_back(i);
+        }
+        n2 += vec.size();
+    });
+    std::cout << "peak " << peak_mb() << "MB\n";
+    log_time_action([&]{
+        Vector<int> vec;
+        for (int i = 0; i < count; i++) {
+            vec.push_back(i);
+        }
+        n1 += vec.size();
+    });
+    std::cout << "peak " << peak_mb() << "MB\n";
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+// owns its int like our handle classes, so it is not trivially copyable,
+// but nothing points into it, so it can opt into being relocated as bytes
+template <bool _Relocatable>
+struct Handle {
+    int* ptr;
+
+    Handle (int val = 0) : ptr(new int(val)) {}
+    Handle (const Handle& other) : ptr(new int(*other.ptr)) {}
+    Handle (Handle&& other) : ptr(other.ptr) { other.ptr = nullptr; }
+    ~Handle () { delete ptr; }
+};
+
+template <>
+struct luna::is_trivially_relocatable<Handle<true>> : std::true_type {};
+
+// inserting and removing in the middle of a large vector, shifting half of it every time
+void test_relocate () {
+    int count = 200000;
+    int ops = 2000;
+
+    auto shift = [&]<bool _Relocatable>(Vector<Handle<_Relocatable>>& vec) {
+        for (int i = 0; i < count; i++) {
+            vec.emplace_back(i);
+        }
+        for (int i = 0; i < ops; i++) {
+            vec.emplace(vec.size() / 2, i);
+        }
+        for (int i = 0; i < ops; i++) {
+            vec.remove_ordered(vec.size() / 2);
+        }
+        long sum = 0;
+        for (const auto& handle : vec) {
+            sum += *handle.ptr;
+        }
+        return sum;
+    };
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        Vector<Handle<false>> vec;
+        n1 += shift(vec);
+    });
+    log_time_action([&]{
+        Vector<Handle<true>> vec;
+        n2 += shift(vec);
+    });
+    std::cout << "\n";
+
+    std::cout << n1 << " " << n2 << "\n";
+}
+
+// pushes into a large vector with each growth policy, every one in its own process
+// where fork is available, so its peak RSS is its own, then into millions of tiny ones.
+// growing with std::allocator copies into a new block, while ReallocAllocator remaps in place
+void test_growth_policy () {
+    int count = 100000000;
+    int tiny_count = 2000000;
+
+    auto large = [&]<class _Alloc, class _Growth>(const char* name, _Alloc, _Growth) {
+        std::cout.flush();
+#ifdef LUNA_MMAP
+        if (fork() != 0) {
+            wait(nullptr);
+            return;
+        }
+#endif
+        Vector<int, _Alloc, _Growth> vec;
+        double ms = time_action([&]{
+            for (int i = 0; i < count; i++) {
+                vec.push_back(i);
+            }
+        });
+        std::cout << name << " " << ms << "ms, capacity "
+            << (long)vec.capacity() * sizeof(int) / (1024 * 1024) << "MB";
+#ifdef LUNA_MMAP
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        std::cout << ", peak " << usage.ru_maxrss / 1024 << "MB\n";
+        std::cout.flush();
+        _exit(0);
+#else
+        std::cout << "\n";
+#endif
+    };
+    auto policies = [&]<class _Alloc>(_Alloc alloc) {
+        large("doubling", alloc, GeometricGrowth<>{});
+        large("x1.5", alloc, GeometricGrowth<3, 2>{});
+        large("pages", alloc, PageGrowth<>{});
+        large("size classes", alloc, SizeClassGrowth<>{});
+        large("capped linear", alloc, CappedLinearGrowth<>{});
+        std::cout << "\n";
+    };
+    policies(std::allocator<int>{});
+    policies(ReallocAllocator<int>{});
+
+    auto tiny = [&]<class _Growth>(const char* name, _Growth) {
+        long n = 0;
+        double ms = time_action([&]{
+            Vector<Vector<int, std::allocator<int>, _Growth>> vectors;
+            vectors.reserve(tiny_count);
+            for (int i = 0; i < tiny_count; i++) {
+                vectors.emplace_back();
+                for (int j = 0; j < 12; j++) {
+                    vectors.back().push_back(j);
+                }
+            }
+            for (const auto& vec : vectors) {
+                n += vec.size();
+            }
+        });
+        std::cout << name << " " << ms << "ms " << n << "\n";
+    };
+    tiny("doubling", GeometricGrowth<>{});
+    tiny("doubling from 64 bytes", GeometricGrowth<2, 1, 64>{});
+    tiny("size classes", SizeClassGrowth<>{});
+}
+
+#ifdef LUNA_MMAP
+// reopening a vector kept in a file, against reading the same elements back into a Vector
+void test_mmap_vector () {
+    int count = 50000000;
+    std::string path = (std::filesystem::temp_directory_path() / "luna-mmap-vector").string();
+    std::string raw_path = path + ".raw";
+    std::remove((path + ".0").c_str());
+
+    log_time_action([&]{
+        MmapScope scope(path);
+        MmapVector<int> vec;
+        for (int i = 0; i < count; i++) {
+            vec.push_back(i);
+        }
+    });
+    {
+        Vector<int> vec;
+        for (int i = 0; i < count; i++) {
+            vec.push_back(i);
+        }
+        FILE* file = std::fopen(raw_path.c_str(), "wb");
+        std::fwrite(vec.data(), sizeof(int), vec.size(), file);
+        std::fclose(file);
+    }
+    std::cout << "\n";
+
+    long n1 = 0;
+    long n2 = 0;
+
+    log_time_action([&]{
+        FILE* file = std::fopen(raw_path.c_str(), "rb");
+        Vector<int> vec(count);
+        n1 += std::fread(vec.data(), sizeof(int), count, file);
+        std::fclose(file);
+        for (int i = 0; i < vec.size(); i += 4096) {
+            n1 += vec[i];
+        }
+    });
+    log_time_action([&]{
+        MmapScope scope(path);
+        MmapVector<int> vec;
+        n2 += vec.size();
+        for (int i = 0; i < vec.size(); i += 4096) {
+            n2 += vec[i];
+        }
+    });
+    std::cout << "\n";
+
+    // removed elements stay removed once the file is reopened
+    std::string dense_path = path + ".dense";
+    std::remove((dense_path + ".0").c_str());
+    std::remove((dense_path + ".1").c_str());
+    {
+        MmapScope scope(dense_path);
+        MmapDenseVector<int> vec;
+        for (int i = 0; i < 10; i++) {
+            vec.push_back(i);
+        }
+        vec.remove(3);
+        vec.remove(7);
+    }
+    {
+        MmapScope scope(dense_path);
+        MmapDenseVector<int> vec;
+        assert(vec.size() == 8 && !vec.is_valid(3) && !vec.is_valid(7));
+        assert(vec.push_back(10) == 7);
+    }
+    std::remove((dense_path + ".0").c_str());
+    std::remove((dense_path + ".1").c_str());
+
+    std::remove((path + ".0").c_str());
+    std::remove(raw_path.c_str());
+    std::cout << n1 << " " << n2 << "\n";
+}
+#endif
+
 void test_vector_stack () {
     VectorStack<int> vec;
     vec.push_vector();
@@ -284,7 +1731,34 @@ void test_vector () {
 
 int main () {
     // test_map();
+    // test_bloom_map();
+    // test_probe_map();
+    // test_hashed_set();
+    // test_bucket_reduce();
+    // test_fast_hasher();
+    // test_incremental_map();
+    // test_sharded_map();
+    // test_read_mostly_map();
+    // test_batch_find();
+    // test_hashed_lookup();
+    // test_set_algebra();
+    // test_compact();
+    // test_parallel_build();
+    // test_upsert();
+    // test_map_layout();
+    // test_frozen_map();
+    // test_btree_map();
+    // test_multi_map();
     // test_unordered_vectors();
+    // test_arena();
+    // test_pool_allocator();
+    // test_huge_pages();
+    // test_realloc_growth();
+    // test_relocate();
+    // test_growth_policy();
+#ifdef LUNA_MMAP
+    // test_mmap_vector();
+#endif
     // test_vector_stack();
     // using a = ArrayChunkType
     // asdf<GenericHeapChunk>();